@@ -0,0 +1,502 @@
+/* -*-c++-*- AD-Census - Copyright (C) 2020.
+* Author	: Yingsong Li(Ethan Li) <ethan.li.whu@gmail.com>
+* https://github.com/ethan-li-coding/AD-Census
+* Describe	: kernel and scaling benchmark
+*/
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+#include "ADCensusStereo.h"
+#include "adcensus_trace.h"
+#include "adcensus_util.h"
+#include "synthetic_pair.h"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib,"psapi.lib")
+#else
+#include <sys/resource.h>
+#endif
+using namespace std::chrono;
+
+/** \brief һԳߴ */
+struct BenchConfig {
+	sint32 width;
+	sint32 height;
+	sint32 disp_range;
+	CensusSize census_size;
+	bool grayscale;				// ǷΪҶģʽ
+	bool lazy_right;			// ǷͼӲ
+	float32 aggr_tol;			// ۾ۺӦֵֹͣ0Ϊ̶
+};
+
+/** \brief һԳߴĳһʱĸκʱ */
+struct BenchTiming {
+	std::string name;				// ʱƣںƬƻMatch
+	sint32 calls;					// ƥڵĵô
+	std::vector<float64> ms;		// ظĺʱ룬ͬƬͣ
+};
+
+/** \brief һԳߴĳһ߳µĽ */
+struct BenchRun {
+	BenchConfig config;
+	sint32 threads;
+	std::vector<BenchTiming> timings;	// ΪMatchܺʱ
+	float64 planned_mb;					// ڴع滮СMB
+	float64 peak_rss_mb;				// кĽڴֵMBֵ
+	std::string backends;				// ׶ʵִеļ
+};
+
+/*Գߴ磬ʽΪWxHxD[,WxHxD...]*/
+bool ParseGrid(const char* str, std::vector<BenchConfig>& grid);
+/*߳бʽΪn[,n...]*/
+bool ParseThreads(const char* str, std::vector<sint32>& threads);
+/*ȡٷλȣ*/
+float64 Percentile(std::vector<float64> values, const float64& p);
+/*һԳߴ*/
+bool RunConfig(const BenchConfig& config, const ADCensusBackend backends[Stage_Count], const std::vector<uint8>& img_left,
+			   const std::vector<uint8>& img_right, const sint32& warmup, const sint32& reps, std::vector<BenchTiming>& timings,
+			   std::string& backends_used);
+/*УŻʵοʵ֣ӡ׶λ*/
+bool VerifyConfig(const BenchConfig& config, const std::vector<uint8>& img_left, const std::vector<uint8>& img_right, bool& identical);
+/*-Ӳ/룩*/
+float64 Throughput(const BenchRun& run);
+/*ڴֵֽڣ*/
+size_t GetPeakRSS();
+/*JSON*/
+bool SaveJson(const std::string& path, const std::vector<BenchRun>& runs, const sint32& warmup, const sint32& reps);
+
+/**
+* \brief ں˼չԵĻ׼ԣ޽棬ͼ
+* ΪϳӰԣsynthetic_pairں˺ʱȡ׷ƬΣadcensus_traceÿظͬƬͣ
+* :worker׺ƬΪ̺߳ʱ֮ͣԳߴÿ߳Уڴ漰Ч
+* бٵ߳Ϊ׼ڴֵֻ˰ߴС
+* \param argc --grid WxHxD[,...]	Գߴ磬Ĭ450x375x64,640x480x128
+* \param argc --threads n[,...]	߳ĬΪOpenMPĬ߳
+* \param argc --warmup n			ԤȴĬ1
+* \param argc --reps n				ظĬ5
+* \param argc --json path			JSON·ѡ
+* \param argc --save dir			ߴĺϳӰԼֵӲѡ
+* \param argc --backend spec		ˣoptimizedĬϣreferenceֽ׶aggregation=reference
+*									ʽadcensus_util::ParseBackendsADCENSUS_BACKEND
+* \param argc --census size		censusڳߴ5x59x7Ĭϣ
+* \param argc --isa name			ָscalarsse42avx2avx512ĬΪֵ֧߼𣬲øڸü
+* \param argc --gray				Ҷģʽ׶ζȡͨҶӰADCensusOption::grayscale
+* \param argc --aggr-tol t			۾ۺӦֵֹͣADCensusOption::aggr_converge_ratioĬ0̶4
+* \param argc --lazy-right			һԼʱͼӲADCensusOption::lazy_right_disparity
+* \param argc --verify				ߴŻʵοʵ׶У飨ĬϲȫಽŻһΣڲʱֵΪ-4
+* \param eg. AD-Census-Bench --grid 450x375x64,1280x720x128 --reps 10 --json bench.json
+* \param eg. AD-Census-Bench --grid 1920x1080x256,3840x2160x512 --threads 1,2,4,8 --reps 3
+* \param eg. AD-Census-Bench --verify --reps 1
+*/
+int main(int argc, char** argv)
+{
+	std::vector<BenchConfig> grid = { {450, 375, 64, Census9x7, false, false, 0.0f}, {640, 480, 128, Census9x7, false, false, 0.0f} };
+	CensusSize census_size = Census9x7;
+	bool grayscale = false, lazy_right = false;
+	float32 aggr_tol = 0.0f;
+	std::vector<sint32> threads;
+	sint32 warmup = 1, reps = 5;
+	std::string json_path, save_dir;
+	ADCensusBackend backends[Stage_Count];
+	for (sint32 i = 0; i < Stage_Count; i++) {
+		backends[i] = Backend_Optimized;
+	}
+	bool verify = false, all_identical = true;
+
+	for (sint32 i = 1; i < argc; i++) {
+		const bool has_value = i + 1 < argc;
+		if (strcmp(argv[i], "--grid") == 0 && has_value) {
+			if (!ParseGrid(argv[++i], grid)) {
+				printf("ԳߴʽӦΪWxHxD[,WxHxD...]\n");
+				return -1;
+			}
+		}
+		else if (strcmp(argv[i], "--threads") == 0 && has_value) {
+			if (!ParseThreads(argv[++i], threads)) {
+				printf("߳ʽӦΪn[,n...]\n");
+				return -1;
+			}
+		}
+		else if (strcmp(argv[i], "--warmup") == 0 && has_value) {
+			warmup = std::max(0, atoi(argv[++i]));
+		}
+		else if (strcmp(argv[i], "--reps") == 0 && has_value) {
+			reps = std::max(1, atoi(argv[++i]));
+		}
+		else if (strcmp(argv[i], "--json") == 0 && has_value) {
+			json_path = argv[++i];
+		}
+		else if (strcmp(argv[i], "--save") == 0 && has_value) {
+			save_dir = argv[++i];
+		}
+		else if (strcmp(argv[i], "--backend") == 0 && has_value) {
+			if (!adcensus_util::ParseBackends(argv[++i], backends)) {
+				printf("˸ʽӦΪ׶=[,...]\n");
+				return -1;
+			}
+		}
+		else if (strcmp(argv[i], "--census") == 0 && has_value) {
+			if (!adcensus_util::ParseCensusSize(argv[++i], census_size)) {
+				printf("censusڳߴӦΪ5x59x7\n");
+				return -1;
+			}
+		}
+		else if (strcmp(argv[i], "--isa") == 0 && has_value) {
+			adcensus_util::CpuIsa isa;
+			if (!adcensus_util::ParseIsa(argv[++i], isa)) {
+				printf("ָӦΪscalarsse42avx2avx512\n");
+				return -1;
+			}
+			if (!adcensus_util::SetIsa(isa)) {
+				printf("ָ֧%sΪ%s\n", argv[i], adcensus_util::IsaName(adcensus_util::DetectIsa()));
+				return -1;
+			}
+		}
+		else if (strcmp(argv[i], "--gray") == 0) {
+			grayscale = true;
+		}
+		else if (strcmp(argv[i], "--aggr-tol") == 0 && has_value) {
+			aggr_tol = std::max(0.0f, static_cast<float32>(atof(argv[++i])));
+		}
+		else if (strcmp(argv[i], "--lazy-right") == 0) {
+			lazy_right = true;
+		}
+		else if (strcmp(argv[i], "--verify") == 0) {
+			verify = true;
+		}
+		else {
+			printf("δ֪%s\n", argv[i]);
+			return -1;
+		}
+	}
+
+	for (auto& config : grid) {
+		config.census_size = census_size;
+		config.grayscale = grayscale;
+		config.lazy_right = lazy_right;
+		config.aggr_tol = aggr_tol;
+	}
+	if (threads.empty()) {
+		sint32 num_threads = 1;
+#ifdef _OPENMP
+		num_threads = omp_get_max_threads();
+#endif
+		threads.push_back(num_threads);
+	}
+	printf("warmup = %d, reps = %d, isa = %s\n", warmup, reps, adcensus_util::IsaName(adcensus_util::GetIsa()));
+
+	std::vector<BenchRun> runs;
+	for (auto& config : grid) {
+		std::vector<uint8> img_left, img_right;
+		std::vector<float32> disp_gt;
+		synthetic_pair::Generate(config.width, config.height, config.disp_range, 20200625u, img_left, img_right, disp_gt);
+		if (!save_dir.empty()) {
+			const std::string prefix = save_dir + "/synthetic_" + std::to_string(config.width) + "x" +
+									   std::to_string(config.height) + "x" + std::to_string(config.disp_range);
+			if (!synthetic_pair::Save(prefix, config.width, config.height, img_left, img_right, disp_gt)) {
+				printf("ϳӰʧܣ%s\n", prefix.c_str());
+			}
+		}
+
+		if (verify) {
+			bool identical = true;
+			if (!VerifyConfig(config, img_left, img_right, identical)) {
+				printf("AD-Censusʼʧܣ\n");
+				return -2;
+			}
+			all_identical = all_identical && identical;
+		}
+
+		for (auto& num_threads : threads) {
+#ifdef _OPENMP
+			omp_set_num_threads(num_threads);
+#endif
+			printf("\n%dx%dx%d, census = %s, gray = %d, lazy_right = %d, aggr_tol = %g, threads = %d\n", config.width,
+				   config.height, config.disp_range, adcensus_util::CensusSizeName(config.census_size), config.grayscale ? 1 : 0,
+				   config.lazy_right ? 1 : 0, config.aggr_tol, num_threads);
+			BenchRun run;
+			run.config = config;
+			run.threads = num_threads;
+			if (!RunConfig(config, backends, img_left, img_right, warmup, reps, run.timings, run.backends)) {
+				printf("AD-Censusʼʧܣ\n");
+				return -2;
+			}
+			ADCensusOption option;
+			option.min_disparity = 0;
+			option.max_disparity = config.disp_range;
+			option.census_size = config.census_size;
+			option.grayscale = config.grayscale;
+			option.lazy_right_disparity = config.lazy_right;
+			option.aggr_converge_ratio = config.aggr_tol;
+			run.planned_mb = ADCensusStereo::PlanMemoryFootprint(config.width, config.height, option) / 1048576.0;
+			run.peak_rss_mb = GetPeakRSS() / 1048576.0;
+
+			printf("backends: %s\n", run.backends.c_str());
+			printf("%-28s %6s %12s %12s\n", "kernel", "calls", "median(ms)", "p95(ms)");
+			for (auto& timing : run.timings) {
+				printf("%-28s %6d %12.3lf %12.3lf\n", timing.name.c_str(), timing.calls,
+					   Percentile(timing.ms, 0.5), Percentile(timing.ms, 0.95));
+			}
+			runs.push_back(run);
+		}
+	}
+
+	// չԻܣЧͬһߴ߳Ϊ׼
+	printf("\n%-18s %7s %12s %10s %10s %10s %10s\n", "WxHxD", "threads", "median(ms)", "Mpd/s", "efficiency", "plan(MB)", "rss(MB)");
+	for (size_t i = 0; i < runs.size(); i++) {
+		const auto& run = runs[i];
+		const auto& base = runs[i - i % threads.size()];
+		const float64 efficiency = Throughput(run) * base.threads / (Throughput(base) * run.threads);
+		char dims[64];
+		sprintf(dims, "%dx%dx%d", run.config.width, run.config.height, run.config.disp_range);
+		printf("%-18s %7d %12.3lf %10.2lf %10.2lf %10.1lf %10.1lf\n", dims, run.threads, Percentile(run.timings[0].ms, 0.5),
+			   Throughput(run), efficiency, run.planned_mb, run.peak_rss_mb);
+	}
+
+	if (!json_path.empty()) {
+		if (!SaveJson(json_path, runs, warmup, reps)) {
+			printf("JSONʧܣ%s\n", json_path.c_str());
+			return -3;
+		}
+		printf("\nresults saved to %s\n", json_path.c_str());
+	}
+
+	if (!all_identical) {
+		printf("\nŻʵοʵֽһ£\n");
+		return -4;
+	}
+
+	return 0;
+}
+
+bool ParseGrid(const char* str, std::vector<BenchConfig>& grid)
+{
+	grid.clear();
+	const char* p = str;
+	while (*p != '\0') {
+		BenchConfig config;
+		config.census_size = Census9x7;
+		config.grayscale = false;
+		config.lazy_right = false;
+		config.aggr_tol = 0.0f;
+		sint32 consumed = 0;
+		if (sscanf(p, "%dx%dx%d%n", &config.width, &config.height, &config.disp_range, &consumed) != 3 ||
+			config.width <= 0 || config.height <= 0 || config.disp_range <= 0) {
+			return false;
+		}
+		grid.push_back(config);
+		p += consumed;
+		if (*p == ',') {
+			p++;
+		}
+		else if (*p != '\0') {
+			return false;
+		}
+	}
+	return !grid.empty();
+}
+
+bool ParseThreads(const char* str, std::vector<sint32>& threads)
+{
+	threads.clear();
+	const char* p = str;
+	while (*p != '\0') {
+		sint32 num = 0, consumed = 0;
+		if (sscanf(p, "%d%n", &num, &consumed) != 1 || num <= 0) {
+			return false;
+		}
+		threads.push_back(num);
+		p += consumed;
+		if (*p == ',') {
+			p++;
+		}
+		else if (*p != '\0') {
+			return false;
+		}
+	}
+	// ߳ΪЧʵĻ׼
+	std::sort(threads.begin(), threads.end());
+	return !threads.empty();
+}
+
+float64 Percentile(std::vector<float64> values, const float64& p)
+{
+	if (values.empty()) {
+		return 0.0;
+	}
+	std::sort(values.begin(), values.end());
+	const sint32 rank = static_cast<sint32>(p * values.size() + 0.999999);
+	return values[std::min(std::max(rank, 1), static_cast<sint32>(values.size())) - 1];
+}
+
+bool RunConfig(const BenchConfig& config, const ADCensusBackend backends[Stage_Count], const std::vector<uint8>& img_left,
+			   const std::vector<uint8>& img_right, const sint32& warmup, const sint32& reps, std::vector<BenchTiming>& timings,
+			   std::string& backends_used)
+{
+	const sint32 width = config.width, height = config.height;
+
+	ADCensusOption option;
+	option.min_disparity = 0;
+	option.max_disparity = config.disp_range;
+	option.census_size = config.census_size;
+	option.grayscale = config.grayscale;
+	option.lazy_right_disparity = config.lazy_right;
+	option.aggr_converge_ratio = config.aggr_tol;
+	memcpy(option.stage_backends, backends, sizeof(option.stage_backends));
+
+	ADCensusStereo ad_census;
+	if (!ad_census.Initialize(width, height, option)) {
+		return false;
+	}
+	backends_used.clear();
+	for (sint32 i = 0; i < Stage_Count; i++) {
+		const auto stage = static_cast<ADCensusStage>(i);
+		backends_used += std::string(i == 0 ? "" : ",") + adcensus_util::StageName(stage) + "=" +
+						 adcensus_util::BackendName(ad_census.get_backend(stage));
+	}
+
+	std::vector<float32> disparity(width * height);
+	for (sint32 n = 0; n < warmup; n++) {
+		ad_census.Match(img_left.data(), img_right.data(), disparity.data());
+	}
+
+	timings.clear();
+	timings.push_back({ "Match", 1, std::vector<float64>() });
+	std::map<std::string, size_t> index;
+	std::vector<adcensus_trace::Span> spans;
+	for (sint32 n = 0; n < reps; n++) {
+		adcensus_trace::Clear();
+		adcensus_trace::Enable(true);
+		const auto start = steady_clock::now();
+		ad_census.Match(img_left.data(), img_right.data(), disparity.data());
+		const auto end = steady_clock::now();
+		adcensus_trace::Enable(false);
+		timings[0].ms.push_back(duration_cast<nanoseconds>(end - start).count() / 1e6);
+
+		// ͬƬͣ״γֵ˳ˮ˳
+		adcensus_trace::Collect(spans);
+		std::stable_sort(spans.begin(), spans.end(), [](const adcensus_trace::Span& a, const adcensus_trace::Span& b) {
+			return a.begin_ns < b.begin_ns;
+		});
+		for (size_t k = 1; k < timings.size(); k++) {
+			timings[k].calls = 0;
+			timings[k].ms.push_back(0.0);
+		}
+		for (auto& span : spans) {
+			auto it = index.find(span.name);
+			if (it == index.end()) {
+				// ֮ǰظδֵƬΣ
+				it = index.insert(std::make_pair(std::string(span.name), timings.size())).first;
+				timings.push_back({ span.name, 0, std::vector<float64>(n + 1, 0.0) });
+			}
+			auto& timing = timings[it->second];
+			timing.calls++;
+			timing.ms.back() += (span.end_ns - span.begin_ns) / 1e6;
+		}
+	}
+	return true;
+}
+
+bool VerifyConfig(const BenchConfig& config, const std::vector<uint8>& img_left, const std::vector<uint8>& img_right, bool& identical)
+{
+	ADCensusOption option;
+	option.min_disparity = 0;
+	option.max_disparity = config.disp_range;
+	option.census_size = config.census_size;
+	option.grayscale = config.grayscale;
+	option.lazy_right_disparity = config.lazy_right;
+	option.aggr_converge_ratio = config.aggr_tol;
+
+	// ĬϲУ飬ٿಽŻȫ裨һԼ顢估У飬ʹÿŻʵ־οʵֱȶ
+	identical = true;
+	for (sint32 k = 0; k < 2; k++) {
+		option.do_lr_check = true;
+		option.do_filling = true;
+		option.do_discontinuity_adjustment = (k == 1);
+
+		ADCensusStereo ad_census;
+		std::vector<ADCensusBufferDiff> diffs;
+		if (!ad_census.Initialize(config.width, config.height, option) ||
+			!ad_census.Verify(img_left.data(), img_right.data(), diffs)) {
+			return false;
+		}
+
+		printf("\nverify %dx%dx%d, %s (optimized vs reference)\n", config.width, config.height, config.disp_range,
+			   (k == 0) ? "default" : "all refine steps");
+		printf("%-12s %-14s %12s %12s %10s %12s %12s\n", "stage", "buffer", "elements", "different", "invalid", "max_diff", "mean_diff");
+		for (auto& diff : diffs) {
+			printf("%-12s %-14s %12lld %12lld %10lld %12.6g %12.6g\n", adcensus_util::StageName(diff.stage), diff.buffer,
+				   static_cast<long long>(diff.num_elements), static_cast<long long>(diff.num_different),
+				   static_cast<long long>(diff.num_invalid), diff.max_diff, diff.mean_diff);
+			identical = identical && diff.num_different == 0;
+		}
+	}
+	return true;
+}
+
+float64 Throughput(const BenchRun& run)
+{
+	const float64 num_pd = float64(run.config.width) * run.config.height * run.config.disp_range;
+	return num_pd / (Percentile(run.timings[0].ms, 0.5) * 1e3);
+}
+
+size_t GetPeakRSS()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS pmc;
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc))) {
+		return pmc.PeakWorkingSetSize;
+	}
+	return 0;
+#else
+	rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0) {
+		return 0;
+	}
+#ifdef __APPLE__
+	return static_cast<size_t>(usage.ru_maxrss);
+#else
+	return static_cast<size_t>(usage.ru_maxrss) * 1024;
+#endif
+#endif
+}
+
+bool SaveJson(const std::string& path, const std::vector<BenchRun>& runs, const sint32& warmup, const sint32& reps)
+{
+	FILE* fp = fopen(path.c_str(), "w");
+	if (fp == nullptr) {
+		return false;
+	}
+
+	fprintf(fp, "{\n  \"warmup\": %d,\n  \"reps\": %d,\n  \"isa\": \"%s\",\n  \"runs\": [", warmup, reps,
+			adcensus_util::IsaName(adcensus_util::GetIsa()));
+	for (size_t i = 0; i < runs.size(); i++) {
+		const auto& run = runs[i];
+		fprintf(fp, "%s\n    {\"width\": %d, \"height\": %d, \"disp_range\": %d, \"census\": \"%s\", \"gray\": %s, \"lazy_right\": %s, \"aggr_tol\": %g, \"threads\": %d, "
+				"\"mpd_per_s\": %.3lf, \"planned_mb\": %.1lf, \"peak_rss_mb\": %.1lf, \"backends\": \"%s\", \"kernels\": [",
+				i == 0 ? "" : ",", run.config.width, run.config.height, run.config.disp_range,
+				adcensus_util::CensusSizeName(run.config.census_size), run.config.grayscale ? "true" : "false",
+				run.config.lazy_right ? "true" : "false", run.config.aggr_tol, run.threads,
+				Throughput(run), run.planned_mb, run.peak_rss_mb, run.backends.c_str());
+		for (size_t k = 0; k < run.timings.size(); k++) {
+			const auto& timing = run.timings[k];
+			fprintf(fp, "%s\n      {\"name\": \"%s\", \"calls\": %d, \"median_ms\": %.4lf, \"p95_ms\": %.4lf, \"min_ms\": %.4lf}",
+					k == 0 ? "" : ",", timing.name.c_str(), timing.calls, Percentile(timing.ms, 0.5), Percentile(timing.ms, 0.95),
+					Percentile(timing.ms, 0.0));
+		}
+		fprintf(fp, "\n    ]}");
+	}
+	fprintf(fp, "\n  ]\n}\n");
+
+	fclose(fp);
+	return true;
+}
@@ -0,0 +1,200 @@
+/* -*-c++-*- AD-Census - Copyright (C) 2020.
+* Author	: Yingsong Li(Ethan Li) <ethan.li.whu@gmail.com>
+* https://github.com/ethan-li-coding/AD-Census
+* Describe	: implement of synthetic rectified stereo pairs
+*/
+
+#include "synthetic_pair.h"
+#include "disparity_writer.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+namespace
+{
+	/** \brief ƽ */
+	enum RegionType {
+		Region_All = 0,		// ȫͼ
+		Region_Rect,		// 
+		Region_Disc			// Բ
+	};
+
+	/** \brief ƽ棬Ӳd = a + b*x + c*yͼ궨 */
+	struct ScenePlane {
+		float32 a, b, c;
+		RegionType type;
+		float32 x0, y0, x1, y1;		// ηΧԲ(x0,y0)뾶x1
+		uint32 id;					// 
+		float32 base[3];			// ɫ
+	};
+
+	/** \brief ͬ */
+	struct Lcg {
+		uint32 state;
+		explicit Lcg(const uint32& seed) : state(seed) {}
+		uint32 Next() { state = state * 1664525u + 1013904223u; return state; }
+		float32 Uniform(const float32& lo, const float32& hi) { return lo + (hi - lo) * (Next() >> 8) / 16777216.0f; }
+	};
+
+	/** \brief ϣ[0,1) */
+	inline float32 Hash(const sint32& ix, const sint32& iy, const uint32& id)
+	{
+		uint32 h = static_cast<uint32>(ix) * 73856093u ^ static_cast<uint32>(iy) * 19349663u ^ id * 83492791u;
+		h ^= h >> 16; h *= 0x85ebca6bu;
+		h ^= h >> 13; h *= 0xc2b2ae35u;
+		h ^= h >> 16;
+		return (h >> 8) / 16777216.0f;
+	}
+
+	/** \brief ˫ԲֵֵΪperiod */
+	inline float32 ValueNoise(const float32& x, const float32& y, const float32& period, const uint32& id)
+	{
+		const float32 u = x / period, v = y / period;
+		const sint32 iu = static_cast<sint32>(floor(u)), iv = static_cast<sint32>(floor(v));
+		const float32 fu = u - iu, fv = v - iv;
+		const float32 h00 = Hash(iu, iv, id), h10 = Hash(iu + 1, iv, id);
+		const float32 h01 = Hash(iu, iv + 1, id), h11 = Hash(iu + 1, iv + 1, id);
+		return (h00 * (1 - fu) + h10 * fu) * (1 - fv) + (h01 * (1 - fu) + h11 * fu) * fv;
+	}
+
+	/** \brief ͼ(x,y)Ƿƽ */
+	inline bool Contains(const ScenePlane& plane, const float32& x, const float32& y)
+	{
+		switch (plane.type) {
+		case Region_Rect:
+			return x >= plane.x0 && x < plane.x1 && y >= plane.y0 && y < plane.y1;
+		case Region_Disc:
+			return (x - plane.x0) * (x - plane.x0) + (y - plane.y0) * (y - plane.y0) < plane.x1 * plane.x1;
+		default:
+			return true;
+		}
+	}
+
+	/** \brief ƽͼ(x,y)ɫ߶ȵڻɫ */
+	inline void Shade(const ScenePlane& plane, const float32& x, const float32& y, uint8* bgr)
+	{
+		for (sint32 k = 0; k < 3; k++) {
+			const uint32 id = plane.id * 3 + k;
+			const float32 val = plane.base[k] + 70.0f * (ValueNoise(x, y, 9.0f, id) - 0.5f) +
+								60.0f * (ValueNoise(x, y, 2.5f, id + 1000u) - 0.5f);
+			bgr[k] = static_cast<uint8>(std::max(0.0f, std::min(255.0f, val)));
+		}
+	}
+}
+
+void synthetic_pair::Generate(const sint32& width, const sint32& height, const sint32& disp_range, const uint32& seed,
+							  std::vector<uint8>& img_left, std::vector<uint8>& img_right, std::vector<float32>& disp_left)
+{
+	Lcg rng(seed);
+	const float32 dr = static_cast<float32>(disp_range);
+
+	// бƽ棬Ӳ0.150.45ӲΧ
+	std::vector<ScenePlane> planes;
+	ScenePlane bg;
+	bg.type = Region_All;
+	bg.b = 0.2f * dr / width;
+	bg.c = 0.1f * dr / height;
+	bg.a = 0.15f * dr;
+	bg.x0 = bg.y0 = bg.x1 = bg.y1 = 0.0f;
+	planes.push_back(bg);
+
+	// ڵλԲΣбӲ仯0.05ӲΧ
+	const sint32 num_occluders = 3 + static_cast<sint32>(rng.Next() % 3);
+	for (sint32 n = 0; n < num_occluders; n++) {
+		ScenePlane plane;
+		const float32 size = rng.Uniform(0.1f, 0.3f) * std::min(width, height);
+		const float32 cx = rng.Uniform(0.1f, 0.9f) * width;
+		const float32 cy = rng.Uniform(0.1f, 0.9f) * height;
+		const float32 dc = rng.Uniform(0.5f, 0.85f) * dr;
+		const bool slanted = (rng.Next() & 1) != 0;
+		plane.b = slanted ? rng.Uniform(-0.025f, 0.025f) * dr / size : 0.0f;
+		plane.c = slanted ? rng.Uniform(-0.025f, 0.025f) * dr / size : 0.0f;
+		plane.a = dc - plane.b * cx - plane.c * cy;
+		if ((rng.Next() & 1) != 0) {
+			plane.type = Region_Rect;
+			plane.x0 = cx - size; plane.x1 = cx + size;
+			plane.y0 = cy - 0.6f * size; plane.y1 = cy + 0.6f * size;
+		}
+		else {
+			plane.type = Region_Disc;
+			plane.x0 = cx; plane.y0 = cy; plane.x1 = size;
+			plane.y1 = 0.0f;
+		}
+		planes.push_back(plane);
+	}
+	for (size_t i = 0; i < planes.size(); i++) {
+		planes[i].id = seed * 31u + static_cast<uint32>(i);
+		for (sint32 k = 0; k < 3; k++) {
+			planes[i].base[k] = rng.Uniform(60.0f, 196.0f);
+		}
+	}
+
+	img_left.resize(width * height * 3);
+	img_right.resize(width * height * 3);
+	disp_left.resize(width * height);
+
+	// ѡȡӲĿɼƽ
+#pragma omp parallel for schedule(static)
+	for (sint32 y = 0; y < height; y++) {
+		const float32 fy = static_cast<float32>(y);
+		for (sint32 x = 0; x < width; x++) {
+			const float32 fx = static_cast<float32>(x);
+
+			// ͼƽ
+			sint32 best = -1;
+			float32 best_d = -1.0f;
+			for (sint32 i = 0; i < static_cast<sint32>(planes.size()); i++) {
+				const auto& plane = planes[i];
+				const float32 d = plane.a + plane.b * fx + plane.c * fy;
+				if (d > best_d && Contains(plane, fx, fy)) {
+					best = i; best_d = d;
+				}
+			}
+			Shade(planes[best], fx, fy, &img_left[(y * width + x) * 3]);
+			disp_left[y * width + x] = best_d;
+
+			// ͼxr = xl - d(xl,y)ƽ϶Ӧͼxl
+			best = -1;
+			best_d = -1.0f;
+			float32 best_xl = 0.0f;
+			for (sint32 i = 0; i < static_cast<sint32>(planes.size()); i++) {
+				const auto& plane = planes[i];
+				const float32 xl = (fx + plane.a + plane.c * fy) / (1.0f - plane.b);
+				const float32 d = xl - fx;
+				if (d > best_d && Contains(plane, xl, fy)) {
+					best = i; best_d = d; best_xl = xl;
+				}
+			}
+			Shade(planes[best], best_xl, fy, &img_right[(y * width + x) * 3]);
+		}
+	}
+}
+
+bool synthetic_pair::Save(const std::string& prefix, const sint32& width, const sint32& height,
+						  const std::vector<uint8>& img_left, const std::vector<uint8>& img_right, const std::vector<float32>& disp_left)
+{
+	// ӰΪPPMRGB˳
+	for (sint32 n = 0; n < 2; n++) {
+		const auto& img = (n == 0) ? img_left : img_right;
+		const std::string path = prefix + ((n == 0) ? "_left.ppm" : "_right.ppm");
+		FILE* fp = fopen(path.c_str(), "wb");
+		if (fp == nullptr) {
+			return false;
+		}
+		fprintf(fp, "P6\n%d %d\n255\n", width, height);
+		std::vector<uint8> row(width * 3);
+		for (sint32 y = 0; y < height; y++) {
+			for (sint32 x = 0; x < width; x++) {
+				row[3 * x] = img[(y * width + x) * 3 + 2];
+				row[3 * x + 1] = img[(y * width + x) * 3 + 1];
+				row[3 * x + 2] = img[(y * width + x) * 3];
+			}
+			fwrite(row.data(), 1, row.size(), fp);
+		}
+		fclose(fp);
+	}
+
+	// ֵӲΪPFMӲͼʹͬһдʵֽ֣¶ϣ
+	const ADDisparityView disp(const_cast<float32*>(disp_left.data()), width * sizeof(float32));
+	return DisparityWriter::WritePfm(prefix + "_disp.pfm", disp, width, height);
+}
@@ -0,0 +1,41 @@
+/* -*-c++-*- AD-Census - Copyright (C) 2020.
+* Author	: Yingsong Li(Ethan Li) <ethan.li.whu@gmail.com>
+* https://github.com/ethan-li-coding/AD-Census
+* Describe	: header of synthetic rectified stereo pairs
+*/
+#ifndef AD_CENSUS_SYNTHETIC_PAIR_H_
+#define AD_CENSUS_SYNTHETIC_PAIR_H_
+
+#include <string>
+#include <vector>
+#include "adcensus_types.h"
+
+/**
+ * \brief ϳɺӰԣֵӲ
+ * ƽɣһбıƽ棬бԵľΡԲڵ
+ * ƽӲͼΪԺd = a + b*x + c*yƽ棨ͼΪ
+ * ͼӳزӲߣߣڵӲСߣʵڵ
+ */
+namespace synthetic_pair
+{
+	/**
+	 * \brief ɺϳӰ
+	 * \param width			Ӱ
+	 * \param height		Ӱ
+	 * \param disp_range	ӲΧӲλ[0.1, 0.9]ӲΧ
+	 * \param seed			ӣͬͬӰ
+	 * \param img_left		Ӱ3ͨBGR
+	 * \param img_right		Ӱ3ͨBGR
+	 * \param disp_left		ͼֵӲ
+	 */
+	void Generate(const sint32& width, const sint32& height, const sint32& disp_range, const uint32& seed,
+				  std::vector<uint8>& img_left, std::vector<uint8>& img_right, std::vector<float32>& disp_left);
+
+	/**
+	 * \brief ϳӰԣprefix_left.ppmprefix_right.ppmprefix_disp.pfm
+	 * \return true: ɹ
+	 */
+	bool Save(const std::string& prefix, const sint32& width, const sint32& height,
+			  const std::vector<uint8>& img_left, const std::vector<uint8>& img_right, const std::vector<float32>& disp_left);
+}
+#endif
@@ -0,0 +1,339 @@
+/* -*-c++-*- AD-Census - Copyright (C) 2020.
+* Author	: Yingsong Li(Ethan Li) <ethan.li.whu@gmail.com>
+* https://github.com/ethan-li-coding/AD-Census
+* Describe	: accuracy vs speed evaluation
+*/
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "ADCensusStereo.h"
+#include "adcensus_util.h"
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib,"psapi.lib")
+#elif defined(__APPLE__)
+#include <mach/mach.h>
+#else
+#include <unistd.h>
+#endif
+
+// opencv library
+#include <opencv2/opencv.hpp>
+#ifdef _DEBUG
+#pragma comment(lib,"opencv_world310d.lib")
+#else
+#pragma comment(lib,"opencv_world310.lib")
+#endif
+
+/** \brief ݼ */
+struct EvalDataset {
+	const char* name;			// ݼƣDataµĿ¼
+	const char* left;			// Ӱļ
+	const char* right;			// Ӱļ
+	const char* gt_left;		// ͼֵӲͼļnullptrʾֵ
+	const char* gt_right;		// ͼֵӲͼļжڵ
+	sint32 gt_scale;			// ֵӲͼĻҶֵӲı
+};
+
+/** \brief Ĭϲ޸ */
+struct EvalProfile {
+	const char* name;						// 
+	bool do_lr_check;						// Ƿһ
+	bool do_filling;						// ǷӲ
+	bool do_discontinuity_adjustment;		// Ƿ
+	CensusSize census_size;					// censusڳߴ
+	ADCensusBackend backend;				// 
+	sint32 isa;								// ָadcensus_util::CpuIsa-1ʾĬϼ𣬱֧ʱ÷
+	bool grayscale;							// ǷΪҶģʽ
+	float32 aggr_converge_ratio;			// ۾ۺӦֵֹͣ0ʾ̶
+};
+
+/** \brief  */
+struct EvalResult {
+	float64 bad1_nonocc, bad2_nonocc;		// ڵ12صı
+	float64 bad1_all, bad2_all;				// ֵ12صı
+	float64 match_ms;						// ƥʱ룩
+	float64 rss_mb;							// ĳפڴMBƥʵδͷʱԳʼǰ
+	float64 planned_mb;						// ڴع滮СMB
+};
+
+/** \brief ԴݼConeΪ2003ķ֮һߴ磨Ӳ4Cloth3Wood2Ϊ2006֮һߴ磨Ӳ2Pianoֵ */
+const EvalDataset kDatasets[] = {
+	{ "Cone",	"im2.png",		"im6.png",		"disp2.png",	"disp6.png",	4 },
+	{ "Cloth3",	"view1.png",	"view5.png",	"disp1.png",	"disp5.png",	2 },
+	{ "Wood2",	"view1.png",	"view5.png",	"disp1.png",	"disp5.png",	2 },
+	{ "Piano",	"im0.png",		"im1.png",		nullptr,		nullptr,		1 },
+};
+
+/** \brief ģʽˡָҶȡӦۺϣӦһУԶ侫ȴ */
+const EvalProfile kProfiles[] = {
+	{ "default",		true,	true,	false,	Census9x7,	Backend_Optimized,	-1,								false,	0.0f },
+	{ "no-filling",		true,	false,	false,	Census9x7,	Backend_Optimized,	-1,								false,	0.0f },
+	{ "no-lrcheck",		false,	false,	false,	Census9x7,	Backend_Optimized,	-1,								false,	0.0f },
+	{ "discontinuity",	true,	true,	true,	Census9x7,	Backend_Optimized,	-1,								false,	0.0f },
+	{ "census5x5",		true,	true,	false,	Census5x5,	Backend_Optimized,	-1,								false,	0.0f },
+	{ "reference",		true,	true,	false,	Census9x7,	Backend_Reference,	-1,								false,	0.0f },
+	{ "reference-disc",	true,	true,	true,	Census9x7,	Backend_Reference,	-1,								false,	0.0f },
+	{ "isa-scalar",		true,	true,	false,	Census9x7,	Backend_Optimized,	adcensus_util::Isa_Scalar,		false,	0.0f },
+	{ "isa-sse42",		true,	true,	false,	Census9x7,	Backend_Optimized,	adcensus_util::Isa_SSE42,		false,	0.0f },
+	{ "isa-avx2",		true,	true,	false,	Census9x7,	Backend_Optimized,	adcensus_util::Isa_AVX2,		false,	0.0f },
+	{ "isa-avx512",		true,	true,	false,	Census9x7,	Backend_Optimized,	adcensus_util::Isa_AVX512,		false,	0.0f },
+	{ "grayscale",		true,	true,	false,	Census9x7,	Backend_Optimized,	-1,								true,	0.0f },
+	{ "aggr-tol-0.1",	true,	true,	false,	Census9x7,	Backend_Optimized,	-1,								false,	0.1f },
+	{ "aggr-tol-0.2",	true,	true,	false,	Census9x7,	Backend_Optimized,	-1,								false,	0.2f },
+};
+
+/*ȡӲΧļdmin=?dmax=?*/
+bool ReadDisparityRange(const std::string& path, sint32& min_disparity, sint32& max_disparity);
+/*ȡɫӰΪBGR*/
+bool LoadColorImage(const std::string& path, std::vector<uint8>& bytes, sint32& width, sint32& height);
+/*ȡֵӲͼ0ΪЧ*/
+bool LoadGroundTruth(const std::string& path, const sint32& scale, const sint32& width, const sint32& height, std::vector<float32>& disp);
+/*ͳƥ*/
+void Evaluate(const float32* disp, const std::vector<float32>& gt_left, const std::vector<float32>& gt_right, const sint32& width, const sint32& height, EvalResult& result);
+/*̵ǰĳפڴ棨ֽڣ޷ȡʱΪ0*/
+size_t GetCurrentRSS();
+
+/**
+* \brief ٶԴݼԸУƥʡʱڴ
+* ڵֵӲͼһԵõ֮1Ϊڵ
+* ڴΪĳפڴrssڴع滮Сplan
+* \param argc --data dir	ݼĿ¼Ĭ..\Data
+* \param argc --json path	JSON·ѡ
+* \param eg. AD-Census-Eval --data ..\Data --json eval.json
+*/
+int main(int argc, char** argv)
+{
+	std::string data_dir = "../Data";
+	std::string json_path;
+	for (sint32 i = 1; i < argc; i++) {
+		const bool has_value = i + 1 < argc;
+		if (strcmp(argv[i], "--data") == 0 && has_value) {
+			data_dir = argv[++i];
+		}
+		else if (strcmp(argv[i], "--json") == 0 && has_value) {
+			json_path = argv[++i];
+		}
+		else {
+			printf("δ֪%s\n", argv[i]);
+			return -1;
+		}
+	}
+
+	FILE* fp_json = nullptr;
+	if (!json_path.empty()) {
+		fp_json = fopen(json_path.c_str(), "w");
+		if (fp_json == nullptr) {
+			printf("޷JSONļ%s\n", json_path.c_str());
+			return -1;
+		}
+		fprintf(fp_json, "{\n  \"results\": [");
+	}
+	bool first_result = true;
+
+	// ָָĬϼ
+	const adcensus_util::CpuIsa default_isa = adcensus_util::GetIsa();
+
+	printf("%-8s %-14s %9s %9s %9s %9s %10s %10s %10s\n", "dataset", "profile", "bad1-noc", "bad2-noc",
+		   "bad1-all", "bad2-all", "time(ms)", "rss+(MB)", "plan(MB)");
+	for (auto& dataset : kDatasets) {
+		const std::string dir = data_dir + "/" + dataset.name + "/";
+
+		// ȡӰӲΧֵ
+		std::vector<uint8> bytes_left, bytes_right;
+		sint32 width = 0, height = 0, width_r = 0, height_r = 0;
+		ADCensusOption option;
+		if (!LoadColorImage(dir + dataset.left, bytes_left, width, height) ||
+			!LoadColorImage(dir + dataset.right, bytes_right, width_r, height_r) ||
+			width != width_r || height != height_r ||
+			!ReadDisparityRange(dir + "d_range.txt", option.min_disparity, option.max_disparity)) {
+			printf("%-8s ȡʧܣ\n", dataset.name);
+			continue;
+		}
+		std::vector<float32> gt_left, gt_right;
+		const bool has_gt = dataset.gt_left != nullptr &&
+							LoadGroundTruth(dir + dataset.gt_left, dataset.gt_scale, width, height, gt_left) &&
+							LoadGroundTruth(dir + dataset.gt_right, dataset.gt_scale, width, height, gt_right);
+
+		std::vector<float32> disparity(width * height);
+		for (auto& profile : kProfiles) {
+			option.do_lr_check = profile.do_lr_check;
+			option.do_filling = profile.do_filling;
+			option.do_discontinuity_adjustment = profile.do_discontinuity_adjustment;
+			option.census_size = profile.census_size;
+			option.backend = profile.backend;
+			option.backend_from_env = false;
+			option.grayscale = profile.grayscale;
+			option.aggr_converge_ratio = profile.aggr_converge_ratio;
+			const adcensus_util::CpuIsa isa = profile.isa < 0 ? default_isa : static_cast<adcensus_util::CpuIsa>(profile.isa);
+			if (!adcensus_util::SetIsa(isa)) {
+				printf("%-8s %-14s ֧%s\n", dataset.name, profile.name, adcensus_util::IsaName(isa));
+				continue;
+			}
+
+			// ڴֵΪֵܷӳԳʼǰĳפڴ֮
+			const size_t rss_before = GetCurrentRSS();
+			ADCensusStereo ad_census;
+			ADCensusStats stats;
+			const bool ok = ad_census.Initialize(width, height, option) &&
+							ad_census.Match(bytes_left.data(), bytes_right.data(), disparity.data(), &stats);
+			adcensus_util::SetIsa(default_isa);
+			if (!ok) {
+				printf("%-8s %-14s ƥʧ\n", dataset.name, profile.name);
+				continue;
+			}
+
+			EvalResult result;
+			result.bad1_nonocc = result.bad2_nonocc = result.bad1_all = result.bad2_all = -1.0;
+			if (has_gt) {
+				Evaluate(disparity.data(), gt_left, gt_right, width, height, result);
+			}
+			result.match_ms = stats.total_ns / 1e6;
+			const size_t rss_after = GetCurrentRSS();
+			result.rss_mb = (rss_after > rss_before) ? (rss_after - rss_before) / 1048576.0 : 0.0;
+			result.planned_mb = ADCensusStereo::PlanMemoryFootprint(width, height, option) / 1048576.0;
+
+			if (has_gt) {
+				printf("%-8s %-14s %8.2lf%% %8.2lf%% %8.2lf%% %8.2lf%% %10.1lf %10.1lf %10.1lf\n", dataset.name, profile.name,
+					   result.bad1_nonocc * 100, result.bad2_nonocc * 100, result.bad1_all * 100, result.bad2_all * 100,
+					   result.match_ms, result.rss_mb, result.planned_mb);
+			}
+			else {
+				printf("%-8s %-14s %9s %9s %9s %9s %10.1lf %10.1lf %10.1lf\n", dataset.name, profile.name, "-", "-", "-", "-",
+					   result.match_ms, result.rss_mb, result.planned_mb);
+			}
+			if (fp_json != nullptr) {
+				fprintf(fp_json, "%s\n    {\"dataset\": \"%s\", \"profile\": \"%s\", \"width\": %d, \"height\": %d, "
+						"\"min_disparity\": %d, \"max_disparity\": %d, \"backend\": \"%s\", \"isa\": \"%s\", "
+						"\"grayscale\": %s, \"aggr_converge_ratio\": %.3f, \"aggr_iters\": %d, \"has_gt\": %s, "
+						"\"bad1_nonocc\": %.6lf, \"bad2_nonocc\": %.6lf, \"bad1_all\": %.6lf, \"bad2_all\": %.6lf, "
+						"\"match_ms\": %.3lf, \"rss_mb\": %.1lf, \"planned_mb\": %.1lf}",
+						first_result ? "" : ",", dataset.name, profile.name, width, height,
+						option.min_disparity, option.max_disparity, adcensus_util::BackendName(option.backend), adcensus_util::IsaName(isa),
+						option.grayscale ? "true" : "false", option.aggr_converge_ratio, stats.num_aggr_iters, has_gt ? "true" : "false",
+						result.bad1_nonocc, result.bad2_nonocc, result.bad1_all, result.bad2_all,
+						result.match_ms, result.rss_mb, result.planned_mb);
+				first_result = false;
+			}
+		}
+	}
+
+	if (fp_json != nullptr) {
+		fprintf(fp_json, "\n  ]\n}\n");
+		fclose(fp_json);
+		printf("\nresults saved to %s\n", json_path.c_str());
+	}
+	return 0;
+}
+
+bool ReadDisparityRange(const std::string& path, sint32& min_disparity, sint32& max_disparity)
+{
+	FILE* fp = fopen(path.c_str(), "r");
+	if (fp == nullptr) {
+		return false;
+	}
+	const bool ok = fscanf(fp, " dmin=%d dmax=%d", &min_disparity, &max_disparity) == 2;
+	fclose(fp);
+	return ok && max_disparity > min_disparity;
+}
+
+bool LoadColorImage(const std::string& path, std::vector<uint8>& bytes, sint32& width, sint32& height)
+{
+	cv::Mat img = cv::imread(path, cv::IMREAD_COLOR);
+	if (img.data == nullptr) {
+		return false;
+	}
+	width = img.cols;
+	height = img.rows;
+	bytes.resize(width * height * 3);
+	for (sint32 i = 0; i < height; i++) {
+		for (sint32 j = 0; j < width; j++) {
+			bytes[i * 3 * width + 3 * j] = img.at<cv::Vec3b>(i, j)[0];
+			bytes[i * 3 * width + 3 * j + 1] = img.at<cv::Vec3b>(i, j)[1];
+			bytes[i * 3 * width + 3 * j + 2] = img.at<cv::Vec3b>(i, j)[2];
+		}
+	}
+	return true;
+}
+
+bool LoadGroundTruth(const std::string& path, const sint32& scale, const sint32& width, const sint32& height, std::vector<float32>& disp)
+{
+	cv::Mat img = cv::imread(path, cv::IMREAD_GRAYSCALE);
+	if (img.data == nullptr || img.cols != width || img.rows != height) {
+		return false;
+	}
+	disp.resize(width * height);
+	for (sint32 i = 0; i < height; i++) {
+		for (sint32 j = 0; j < width; j++) {
+			const uint8 val = img.at<uchar>(i, j);
+			disp[i * width + j] = (val == 0) ? Invalid_Float : static_cast<float32>(val) / scale;
+		}
+	}
+	return true;
+}
+
+void Evaluate(const float32* disp, const std::vector<float32>& gt_left, const std::vector<float32>& gt_right, const sint32& width, const sint32& height, EvalResult& result)
+{
+	sint32 num_all = 0, num_nonocc = 0;
+	sint32 bad1_all = 0, bad2_all = 0, bad1_nonocc = 0, bad2_nonocc = 0;
+	for (sint32 i = 0; i < height; i++) {
+		for (sint32 j = 0; j < width; j++) {
+			const float32 gt = gt_left[i * width + j];
+			if (gt == Invalid_Float) {
+				continue;
+			}
+
+			// ͼֵһΪڵ
+			const sint32 jr = static_cast<sint32>(lround(j - gt));
+			const bool nonocc = jr >= 0 && jr < width && gt_right[i * width + jr] != Invalid_Float &&
+								fabs(gt_right[i * width + jr] - gt) <= 1.0f;
+
+			// ЧӲΪƥ
+			const float32 d = disp[i * width + j];
+			const float32 err = (d == Invalid_Float) ? Invalid_Float : fabs(d - gt);
+			num_all++;
+			bad1_all += err > 1.0f;
+			bad2_all += err > 2.0f;
+			if (nonocc) {
+				num_nonocc++;
+				bad1_nonocc += err > 1.0f;
+				bad2_nonocc += err > 2.0f;
+			}
+		}
+	}
+	result.bad1_all = num_all > 0 ? float64(bad1_all) / num_all : 0.0;
+	result.bad2_all = num_all > 0 ? float64(bad2_all) / num_all : 0.0;
+	result.bad1_nonocc = num_nonocc > 0 ? float64(bad1_nonocc) / num_nonocc : 0.0;
+	result.bad2_nonocc = num_nonocc > 0 ? float64(bad2_nonocc) / num_nonocc : 0.0;
+}
+
+size_t GetCurrentRSS()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS pmc;
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc))) {
+		return pmc.WorkingSetSize;
+	}
+	return 0;
+#elif defined(__APPLE__)
+	mach_task_basic_info info;
+	mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+	if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, reinterpret_cast<task_info_t>(&info), &count) != KERN_SUCCESS) {
+		return 0;
+	}
+	return static_cast<size_t>(info.resident_size);
+#else
+	// /proc/self/statmĵڶΪפҳ
+	FILE* fp = fopen("/proc/self/statm", "r");
+	if (fp == nullptr) {
+		return 0;
+	}
+	long long pages_total = 0, pages_resident = 0;
+	const bool ok = fscanf(fp, "%lld %lld", &pages_total, &pages_resident) == 2;
+	fclose(fp);
+	return ok ? static_cast<size_t>(pages_resident) * static_cast<size_t>(sysconf(_SC_PAGESIZE)) : 0;
+#endif
+}
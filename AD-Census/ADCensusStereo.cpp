@@ -4,13 +4,125 @@
 * Describe	: implement of ad-census stereo class
 */
 #include "ADCensusStereo.h"
+#include "adcensus_trace.h"
+#include "adcensus_util.h"
 #include <algorithm>
 #include <chrono>
+#include <cmath>
+#include <cstdlib>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 using namespace std::chrono;
 
-ADCensusStereo::ADCensusStereo(): width_(0), height_(0), img_left_(nullptr), img_right_(nullptr),
-                                  disp_left_(nullptr), disp_right_(nullptr),
-                                  is_initialized_(false) { }
+namespace
+{
+	/**
+	 * \brief ҶӰɫֵt1t2ɨŻtsoϵ
+	 * ֵԲɫӰ趨ҶȲΪȨƽ֮ͨСֵС򽻲ԽԵ
+	 * ϵȡݼConeCloth3Wood2ϵķڵƥ
+	 */
+	const float32 Gray_Threshold_Scale = 0.4f;
+
+	/** \brief ׶ζȡӰʽȡɫֵҶӰ񣨻Ҷģʽ÷ĻҶͼGray_Threshold_ScaleСΪ1 */
+	inline sint32 ColorThreshold(const sint32& threshold, const ADPixelFormat& format)
+	{
+		if (format != Pixel_Gray) {
+			return threshold;
+		}
+		return std::max(static_cast<sint32>(std::lround(threshold * Gray_Threshold_Scale)), 1);
+	}
+
+	/** \brief ۼƣvalue_avalue_bΪͬһԪʵеֵ */
+	struct DiffAccumulator {
+		ADCensusBufferDiff diff;
+		float64 sum;
+		DiffAccumulator(const ADCensusStage& stage, const char* buffer, const sint64& num_elements): sum(0.0) {
+			diff.stage = stage;
+			diff.buffer = buffer;
+			diff.num_elements = num_elements;
+			diff.num_different = 0;
+			diff.num_invalid = 0;
+			diff.max_diff = 0.0;
+			diff.mean_diff = 0.0;
+		}
+		void Add(const float64& value) {
+			if (value != 0.0) {
+				diff.num_different++;
+				diff.max_diff = std::max(diff.max_diff, value);
+				sum += value;
+			}
+		}
+		const ADCensusBufferDiff& Finish() {
+			const sint64 num_valid = diff.num_elements - diff.num_invalid;
+			diff.mean_diff = num_valid > 0 ? sum / num_valid : 0.0;
+			return diff;
+		}
+	};
+
+	/** \brief ȽcensusݣΪHamming */
+	template <typename CensusT>
+	ADCensusBufferDiff CompareCensus(const ADCensusStage& stage, const char* buffer, const CensusT* a, const CensusT* b, const sint64& num,
+									 uint8 (*hamming)(const CensusT&, const CensusT&))
+	{
+		DiffAccumulator acc(stage, buffer, num);
+		for (sint64 i = 0; i < num; i++) {
+			acc.Add(hamming(a[i], b[i]));
+		}
+		return acc.Finish();
+	}
+
+	/** \brief ȽcensusݣԪcensusڳߴ */
+	ADCensusBufferDiff CompareCensus(const ADCensusStage& stage, const char* buffer, const CensusSize& census_size,
+									 const void* a, const void* b, const sint64& num)
+	{
+		const auto& kernels = adcensus_util::GetKernels();
+		if (census_size == Census5x5) {
+			return CompareCensus(stage, buffer, static_cast<const uint32*>(a), static_cast<const uint32*>(b), num, kernels.hamming32);
+		}
+		return CompareCensus(stage, buffer, static_cast<const uint64*>(a), static_cast<const uint64*>(b), num, kernels.hamming64);
+	}
+
+	/** \brief ȽϽۣΪĸ۳ֵ֮ */
+	ADCensusBufferDiff CompareArms(const ADCensusStage& stage, const char* buffer, const CrossArm* a, const CrossArm* b, const sint64& num)
+	{
+		DiffAccumulator acc(stage, buffer, num);
+		for (sint64 i = 0; i < num; i++) {
+			const sint32 diff = std::max(std::max(abs(a[i].left - b[i].left), abs(a[i].right - b[i].right)),
+										 std::max(abs(a[i].top - b[i].top), abs(a[i].bottom - b[i].bottom)));
+			acc.Add(diff);
+		}
+		return acc.Finish();
+	}
+
+	/** \brief ȽϸݣΪֵľֵһΪЧֵInvalid_FloatnanһЧļnum_invalid */
+	ADCensusBufferDiff CompareFloat(const ADCensusStage& stage, const char* buffer, const float32* a, const float32* b, const sint64& num)
+	{
+		DiffAccumulator acc(stage, buffer, num);
+		for (sint64 i = 0; i < num; i++) {
+			const bool valid_a = std::isfinite(a[i]), valid_b = std::isfinite(b[i]);
+			if (!valid_a || !valid_b) {
+				if (valid_a != valid_b) {
+					acc.diff.num_invalid++;
+					acc.diff.num_different++;
+				}
+				continue;
+			}
+			acc.Add(fabs(static_cast<float64>(a[i]) - b[i]));
+		}
+		return acc.Finish();
+	}
+}
+
+ADCensusStereo::ADCensusStereo(): width_(0), height_(0),
+                                  disp_left_(nullptr), disp_left_buffer_(nullptr), disp_right_(nullptr),
+                                  diff_left_h_(nullptr), diff_left_v_(nullptr), diff_right_h_(nullptr), diff_right_v_(nullptr),
+                                  is_initialized_(false)
+{
+	for (sint32 i = 0; i < Stage_Count; i++) {
+		backends_[i] = Backend_Reference;
+	}
+}
 
 ADCensusStereo::~ADCensusStereo()
 {
@@ -19,6 +131,11 @@ ADCensusStereo::~ADCensusStereo()
 }
 
 bool ADCensusStereo::Initialize(const sint32& width, const sint32& height, const ADCensusOption& option)
+{
+	return Reconfigure(width, height, option);
+}
+
+bool ADCensusStereo::Reconfigure(const sint32& width, const sint32& height, const ADCensusOption& option)
 {
 	//  ֵ
 
@@ -28,165 +145,498 @@ bool ADCensusStereo::Initialize(const sint32& width, const sint32& height, const
 	// 㷨
 	option_ = option;
 
+	is_initialized_ = false;
+
 	if (width <= 0 || height <= 0) {
 		return false;
 	}
 
-	// ڴռ
-	const sint32 img_size = width_ * height_;
 	const sint32 disp_range = option_.max_disparity - option_.min_disparity;
 	if (disp_range <= 0) {
 		return false;
 	}
 
-	// Ӳͼ
-	disp_left_ = new float32[img_size];
-	disp_right_ = new float32[img_size];
-
 	// ʼۼ
 	if(!cost_computer_.Initialize(width_,height_,option_.min_disparity,option_.max_disparity)) {
-		is_initialized_ = false;
 		return is_initialized_;
 	}
 
 	// ʼ۾ۺ
 	if(!aggregator_.Initialize(width_, height_,option_.min_disparity,option_.max_disparity)) {
-		is_initialized_ = false;
 		return is_initialized_;
 	}
 
+
 	// ʼಽŻ
 	if (!refiner_.Initialize(width_, height_)) {
-		is_initialized_ = false;
 		return is_initialized_;
 	}
 
-	is_initialized_ = disp_left_ && disp_right_;
+	// ѡ׶εļ
+	if (!SelectBackends()) {
+		return is_initialized_;
+	}
+
+	// ڴػڴռ
+	is_initialized_ = AllocateBuffers();
 
 	return is_initialized_;
 }
 
-bool ADCensusStereo::Match(const uint8* img_left, const uint8* img_right, float32* disp_left)
+bool ADCensusStereo::SelectBackends()
+{
+	// ֽ׶ȫãADCENSUS_BACKENDʱڲڲ±뼴ɶԱȸʵ
+	ADCensusBackend requested[Stage_Count];
+	for (sint32 i = 0; i < Stage_Count; i++) {
+		requested[i] = (option_.stage_backends[i] == Backend_Inherit) ? option_.backend : option_.stage_backends[i];
+		if (requested[i] < 0 || requested[i] >= Backend_Count) {
+			return false;
+		}
+	}
+	if (option_.backend_from_env) {
+		const char* spec = getenv("ADCENSUS_BACKEND");
+		if (spec != nullptr && !adcensus_util::ParseBackends(spec, requested)) {
+			return false;
+		}
+	}
+
+	// ģδעѡʱ˻زοʵ֣¼ʵִеĺ
+	const auto select = [](const ADCensusBackend& backend, const bool& registered) {
+		return registered ? backend : Backend_Reference;
+	};
+	backends_[Stage_Cost] = select(requested[Stage_Cost], cost_computer_.SetBackend(requested[Stage_Cost]));
+	backends_[Stage_Aggregation] = select(requested[Stage_Aggregation], aggregator_.SetBackend(requested[Stage_Aggregation]));
+	backends_[Stage_Scanline] = select(requested[Stage_Scanline], scan_line_.SetBackend(requested[Stage_Scanline]));
+	backends_[Stage_Refine] = select(requested[Stage_Refine], refiner_.SetBackend(requested[Stage_Refine]));
+	// Ӳ㼰ֻһʵ
+	backends_[Stage_Disparity] = Backend_Reference;
+	backends_[Stage_Output] = Backend_Reference;
+
+	return true;
+}
+
+ADCensusBackend ADCensusStereo::get_backend(const ADCensusStage& stage) const
+{
+	return (stage >= 0 && stage < Stage_Count) ? backends_[stage] : Backend_Reference;
+}
+
+size_t ADCensusStereo::PlanMemoryFootprint(const sint32& width, const sint32& height, const ADCensusOption& option)
+{
+	MemoryPlanner planner;
+	if (!PlanBuffers(width, height, option, planner)) {
+		return 0;
+	}
+	return planner.Plan();
+}
+
+bool ADCensusStereo::PlanBuffers(const sint32& width, const sint32& height, const ADCensusOption& option, MemoryPlanner& planner)
+{
+	const sint32 disp_range = option.max_disparity - option.min_disparity;
+	if (width <= 0 || height <= 0 || disp_range <= 0) {
+		return false;
+	}
+
+	const size_t img_size = static_cast<size_t>(width) * height;
+	const size_t vol_size = img_size * disp_range;
+	const size_t census_bytes = (option.census_size == Census5x5) ? sizeof(uint32) : sizeof(uint64);
+
+	// ֽڣ״ʹý׶Σʹý׶Σ
+	// עɨŻʼΪмĴ洢ռ䣬ʳʼ۴ɨŻ׶ΣҶģʽ»ҶӰಽŻ׶
+	const sint32 gray_last = option.grayscale ? Stage_Refine : Stage_Cost;
+	struct BlockDesc { size_t size; sint32 first_stage; sint32 last_stage; };
+	const BlockDesc blocks[Block_Count] = {
+		{ img_size * sizeof(uint8),		Stage_Cost,			gray_last },			// Block_GrayLeft
+		{ img_size * sizeof(uint8),		Stage_Cost,			gray_last },			// Block_GrayRight
+		{ img_size * census_bytes,		Stage_Cost,			Stage_Cost },			// Block_CensusLeft
+		{ img_size * census_bytes,		Stage_Cost,			Stage_Cost },			// Block_CensusRight
+		{ vol_size * sizeof(float32),	Stage_Cost,			Stage_Scanline },		// Block_CostInit
+		{ img_size * sizeof(uint8),		Stage_Aggregation,	Stage_Scanline },		// Block_DiffLeftH
+		{ img_size * sizeof(uint8),		Stage_Aggregation,	Stage_Scanline },		// Block_DiffLeftV
+		{ img_size * sizeof(uint8),		Stage_Aggregation,	Stage_Scanline },		// Block_DiffRightH
+		{ img_size * sizeof(uint8),		Stage_Aggregation,	Stage_Scanline },		// Block_DiffRightV
+		{ img_size * sizeof(CrossArm),	Stage_Aggregation,	Stage_Refine },			// Block_CrossArms
+		{ vol_size * sizeof(float32),	Stage_Aggregation,	Stage_Refine },			// Block_CostAggr
+		{ img_size * sizeof(float32),	Stage_Aggregation,	Stage_Aggregation },	// Block_CostTmp0
+		{ img_size * sizeof(float32),	Stage_Aggregation,	Stage_Aggregation },	// Block_CostTmp1
+		{ img_size * sizeof(uint16),	Stage_Aggregation,	Stage_Aggregation },	// Block_SupCount0
+		{ img_size * sizeof(uint16),	Stage_Aggregation,	Stage_Aggregation },	// Block_SupCount1
+		{ img_size * sizeof(uint16),	Stage_Aggregation,	Stage_Aggregation },	// Block_SupCountTmp
+		{ img_size * sizeof(sint16),	Stage_Refine,		Stage_Refine },			// Block_Labels
+		{ img_size * sizeof(sint32),	Stage_Refine,		Stage_Refine },			// Block_RayMap
+		{ img_size * sizeof(float32),	Stage_Disparity,	Stage_Output },			// Block_DispLeft
+		{ img_size * sizeof(float32),	Stage_Disparity,	Stage_Refine },			// Block_DispRight
+	};
+
+	planner.Clear();
+	for (sint32 i = 0; i < Block_Count; i++) {
+		planner.AddBlock(blocks[i].size, blocks[i].first_stage, blocks[i].last_stage);
+	}
+	return true;
+}
+
+bool ADCensusStereo::AllocateBuffers()
+{
+	// ڹ滮飬ͬʱĻ鹲ڴ
+	MemoryPlanner planner;
+	if (!PlanBuffers(width_, height_, option_, planner)) {
+		return false;
+	}
+	const size_t peak = planner.Plan();
+	size_t offsets[Block_Count];
+	for (sint32 i = 0; i < Block_Count; i++) {
+		offsets[i] = planner.offset(i);
+	}
+
+	// 㹻ʱڴ
+	if (!arena_.Reserve(peak, option_.use_huge_pages)) {
+		return false;
+	}
+	uint8* base = arena_.data();
+
+	// ڴ治㣺ÿMatchʹǰᱻд루ڴĻҲ˻Ӱ죩
+	// ڴҳ״дʱɸе߳ʵʷ䣨first-touchʼʱ
+
+	// Ӳͼ
+	disp_left_buffer_ = reinterpret_cast<float32*>(base + offsets[Block_DispLeft]);
+	disp_left_ = disp_left_buffer_;
+	disp_right_ = reinterpret_cast<float32*>(base + offsets[Block_DispRight]);
+
+	// صɫͼ
+	diff_left_h_ = base + offsets[Block_DiffLeftH];
+	diff_left_v_ = base + offsets[Block_DiffLeftV];
+	diff_right_h_ = base + offsets[Block_DiffRightH];
+	diff_right_v_ = base + offsets[Block_DiffRightV];
+
+	// ۼ
+	cost_computer_.SetBuffers(base + offsets[Block_GrayLeft], base + offsets[Block_GrayRight],
+							  base + offsets[Block_CensusLeft], base + offsets[Block_CensusRight],
+							  reinterpret_cast<float32*>(base + offsets[Block_CostInit]));
+
+	// ۾ۺŻʵԳʼΪʱ壬ʼھۺϿʼʱѿۺϴۣ
+	float32* cost_tmp[2] = { reinterpret_cast<float32*>(base + offsets[Block_CostTmp0]),
+							 reinterpret_cast<float32*>(base + offsets[Block_CostTmp1]) };
+	uint16* sup_count[2] = { reinterpret_cast<uint16*>(base + offsets[Block_SupCount0]),
+							 reinterpret_cast<uint16*>(base + offsets[Block_SupCount1]) };
+	aggregator_.SetBuffers(reinterpret_cast<CrossArm*>(base + offsets[Block_CrossArms]),
+						   reinterpret_cast<float32*>(base + offsets[Block_CostAggr]),
+						   reinterpret_cast<float32*>(base + offsets[Block_CostInit]),
+						   cost_tmp, sup_count,
+						   reinterpret_cast<uint16*>(base + offsets[Block_SupCountTmp]));
+
+	// ಽŻ
+	refiner_.SetBuffers(reinterpret_cast<sint16*>(base + offsets[Block_Labels]), reinterpret_cast<sint32*>(base + offsets[Block_RayMap]));
+
+	return true;
+}
+
+bool ADCensusStereo::Match(const uint8* img_left, const uint8* img_right, float32* disp_left, ADCensusStats* stats)
+{
+	return Match(ADImageView::PackedBGR(img_left, width_), ADImageView::PackedBGR(img_right, width_),
+				 ADDisparityView(disp_left, width_ * static_cast<sint32>(sizeof(float32))), stats);
+}
+
+bool ADCensusStereo::Match(const ADImageView& img_left, const ADImageView& img_right, const ADDisparityView& disp_left, ADCensusStats* stats)
 {
 	if (!is_initialized_) {
 		return false;
 	}
-	if (img_left == nullptr || img_right == nullptr || disp_left == nullptr) {
+	if (!CheckView(img_left) || !CheckView(img_right) || disp_left.data == nullptr ||
+		disp_left.stride < width_ * static_cast<sint32>(sizeof(float32))) {
 		return false;
 	}
 
 	img_left_ = img_left;
 	img_right_ = img_right;
 
-	auto start = steady_clock::now();
+	// ͼմ洢ʱֱڵ÷ڴϼͼӲʡȥ
+	const bool direct_output = (disp_left.stride == width_ * static_cast<sint32>(sizeof(float32)));
+	disp_left_ = direct_output ? disp_left.data : disp_left_buffer_;
+
+	// ͳϢstatsǿʱɼ򲻶ȡʱҲκμ
+	steady_clock::time_point start, end;
+	// Ӳڿprofile_hw_countersҿʱȡ
+	bool use_counters = false;
+	sint64 counters_start[PerfCounters::Counter_Count], counters_end[PerfCounters::Counter_Count];
+	const auto stage_done = [&](const ADCensusStage& stage) {
+		if (stats != nullptr) {
+			end = steady_clock::now();
+			stats->stage_ns[stage] = duration_cast<nanoseconds>(end - start).count();
+			stats->total_ns += stats->stage_ns[stage];
+			start = end;
+		}
+		if (use_counters) {
+			perf_counters_.Read(counters_end);
+			const auto delta = [&](const sint32& c) {
+				return (counters_start[c] < 0 || counters_end[c] < 0) ? -1 : counters_end[c] - counters_start[c];
+			};
+			stats->stage_cycles[stage] = delta(PerfCounters::Counter_Cycles);
+			stats->stage_instructions[stage] = delta(PerfCounters::Counter_Instructions);
+			stats->stage_llc_misses[stage] = delta(PerfCounters::Counter_LLCMisses);
+			stats->stage_dtlb_misses[stage] = delta(PerfCounters::Counter_DTLBMisses);
+			memcpy(counters_start, counters_end, sizeof(counters_start));
+		}
+	};
+	if (stats != nullptr) {
+		*stats = ADCensusStats();
+		if (option_.profile_hw_counters) {
+			// ״ʹʱ򿪣ʱLinuxȨ޵ȣͳƺʱ
+			use_counters = perf_counters_.Open();
+			stats->hw_counters_valid = use_counters;
+			if (use_counters) {
+				perf_counters_.Read(counters_start);
+			}
+		}
+		start = steady_clock::now();
+	}
 
 	// ۼ
 	ComputeCost();
-
-	auto end = steady_clock::now();
-	auto tt = duration_cast<milliseconds>(end - start);
-	printf("computing cost! timing :	%lf s\n", tt.count() / 1000.0);
-	start = steady_clock::now();
+	stage_done(Stage_Cost);
 
 	// ۾ۺ
 	CostAggregation();
-
-	end = steady_clock::now();
-	tt = duration_cast<milliseconds>(end - start);
-	printf("cost aggregating! timing :	%lf s\n", tt.count() / 1000.0);
-	start = steady_clock::now();
+	stage_done(Stage_Aggregation);
 
 	// ɨŻ
 	ScanlineOptimize();
+	stage_done(Stage_Scanline);
 
-	end = steady_clock::now();
-	tt = duration_cast<milliseconds>(end - start);
-	printf("scanline optimizing! timing :	%lf s\n", tt.count() / 1000.0);
-	start = steady_clock::now();
-
-	// ͼӲ
+	// ͼӲͼӲʱһԼ
 	ComputeDisparity();
-	ComputeDisparityRight();
-
-	end = steady_clock::now();
-	tt = duration_cast<milliseconds>(end - start);
-	printf("computing disparities! timing :	%lf s\n", tt.count() / 1000.0);
-	start = steady_clock::now();
+	if (!option_.lazy_right_disparity) {
+		ComputeDisparityRight();
+	}
+	stage_done(Stage_Disparity);
 
 	// ಽӲŻ
 	MultiStepRefine();
+	stage_done(Stage_Refine);
 
-	end = steady_clock::now();
-	tt = duration_cast<milliseconds>(end - start);
-	printf("multistep refining! timing :	%lf s\n", tt.count() / 1000.0);
-	start = steady_clock::now();
-
-	// Ӳͼ
-	memcpy(disp_left, disp_left_, height_ * width_ * sizeof(float32));
-	
-	end = steady_clock::now();
-	tt = duration_cast<milliseconds>(end - start);
-	printf("output disparities! timing :	%lf s\n", tt.count() / 1000.0);
+	// Ӳͼֱʱڵ÷ڴ
+	if (direct_output) {
+		disp_left_ = disp_left_buffer_;
+	}
+	else {
+		for (sint32 y = 0; y < height_; y++) {
+			memcpy(disp_left.row(y), disp_left_ + y * width_, width_ * sizeof(float32));
+		}
+	}
+	stage_done(Stage_Output);
+
+	if (stats != nullptr) {
+#ifdef _OPENMP
+		stats->num_threads = omp_get_max_threads();
+#endif
+		stats->num_occlusions = refiner_.get_num_occlusions();
+		stats->num_mismatches = refiner_.get_num_mismatches();
+		stats->num_outliers = stats->num_occlusions + stats->num_mismatches;
+		stats->num_filled = refiner_.get_num_filled();
+		stats->num_aggr_iters = aggregator_.get_num_iters();
+		stats->num_right_evaluated = refiner_.get_num_right_evaluated();
+		memcpy(stats->stage_backends, backends_, sizeof(backends_));
+		ComputeStageBytes(stats);
+		if (direct_output) {
+			stats->stage_bytes[Stage_Output] = 0;
+		}
+	}
 
 	return true;
 }
 
-bool ADCensusStereo::Reset(const uint32& width, const uint32& height, const ADCensusOption& option)
+bool ADCensusStereo::CheckView(const ADImageView& view) const
 {
-	// ͷڴ
-	Release();
+	return view.data != nullptr && view.stride >= width_ * view.pixel_step;
+}
 
-	// óʼ
-	is_initialized_ = false;
+void ADCensusStereo::ComputeStageBytes(ADCensusStats* stats) const
+{
+	// ׶ζҪĶдô
+	const uint64 img_size = static_cast<uint64>(width_) * height_;
+	const uint64 vol_bytes = img_size * (option_.max_disparity - option_.min_disparity) * sizeof(float32);
+	const uint64 img_bytes = img_size * 3;
+	// ۼ֮׶ζȡӰ񣬻ҶģʽΪͨ
+	const uint64 pix_bytes = option_.grayscale ? img_size : img_bytes;
+	const uint64 disp_bytes = img_size * sizeof(float32);
+	const uint64 census_bytes = (option_.census_size == Census5x5) ? sizeof(uint32) : sizeof(uint64);
+	const uint64 num_iters = aggregator_.get_num_iters();
+	// οʵӲȡƽ沢дʱƽ棬Żʵÿεд
+	const uint64 iter_vols = (backends_[Stage_Aggregation] == Backend_Reference) ? 6 : 4;
+
+	// ɫӰдҶcensusдʼ
+	stats->stage_bytes[Stage_Cost] = img_bytes + pix_bytes + 2 * 2 * img_size + 2 * 2 * img_size * census_bytes + vol_bytes;
+	// ӰдصɫͼۣӰɫͼ֧
+	// ʼۡдۺϴۣÿεдۺϴۼʱۣӦʱۺǰÿεأ1/16Ĵ
+	const uint64 sample_vols = (option_.aggr_converge_ratio > 0.0f) ? (num_iters + 1) * vol_bytes / 16 : 0;
+	stats->stage_bytes[Stage_Aggregation] = 3 * pix_bytes + 6 * img_size + img_size * (sizeof(CrossArm) + 3 * sizeof(uint16)) + 2 * vol_bytes +
+											num_iters * iter_vols * vol_bytes + sample_vols;
+	// 4ÿдһۣοʵֶӰŻʵָӰɫͼ
+	const uint64 so_img_bytes = (backends_[Stage_Scanline] == Backend_Reference) ? 2 * pix_bytes : 4 * 2 * img_size;
+	stats->stage_bytes[Stage_Scanline] = so_img_bytes + 4 * 2 * vol_bytes;
+	// ͼһۣдӲͼͼӲʱֻͼͼļһԼ
+	const bool lazy_right = option_.lazy_right_disparity;
+	stats->stage_bytes[Stage_Disparity] = lazy_right ? vol_bytes + disp_bytes : 2 * vol_bytes + 2 * disp_bytes;
+	// һԼ顢ͶƱڲ塢ֵ˲˲ǰĸȶӲͼĶд
+	// ŻʵдһͼڲʱƥڵɨһӲͼռЧأֻЧأƣ
+	const bool refine_optimized = (backends_[Stage_Refine] == Backend_Optimized);
+	const uint64 label_bytes = refine_optimized ? 2 * img_size * sizeof(sint16) : 0;
+	const uint64 ray_bytes = refine_optimized ? 2 * disp_bytes : 0;
+	const uint64 right_bytes = lazy_right ? static_cast<uint64>(refiner_.get_num_right_evaluated()) *
+											(option_.max_disparity - option_.min_disparity + 1) * sizeof(float32) : 0;
+	stats->stage_bytes[Stage_Refine] = 8 * disp_bytes + img_size * sizeof(CrossArm) + pix_bytes + label_bytes + ray_bytes + right_bytes;
+	// Ӳͼ
+	stats->stage_bytes[Stage_Output] = 2 * disp_bytes;
+}
 
-	// ʼ
-	return Initialize(width, height, option);
+bool ADCensusStereo::Verify(const uint8* img_left, const uint8* img_right, std::vector<ADCensusBufferDiff>& diffs)
+{
+	return Verify(ADImageView::PackedBGR(img_left, width_), ADImageView::PackedBGR(img_right, width_), diffs);
+}
+
+bool ADCensusStereo::Verify(const ADImageView& img_left, const ADImageView& img_right, std::vector<ADCensusBufferDiff>& diffs)
+{
+	diffs.clear();
+	if (!is_initialized_ || !CheckView(img_left) || !CheckView(img_right)) {
+		return false;
+	}
+
+	// οʵͬ׶ξʹòοʵҲܻӰ
+	ADCensusOption option = option_;
+	option.backend = Backend_Reference;
+	for (sint32 i = 0; i < Stage_Count; i++) {
+		option.stage_backends[i] = Backend_Inherit;
+	}
+	option.backend_from_env = false;
+	ADCensusStereo reference;
+	if (!reference.Initialize(width_, height_, option)) {
+		return false;
+	}
+
+	ADCensusStereo* stereos[2] = { this, &reference };
+	for (auto stereo : stereos) {
+		stereo->img_left_ = img_left;
+		stereo->img_right_ = img_right;
+	}
+
+	const sint64 img_size = static_cast<sint64>(width_) * height_;
+	const sint64 vol_size = img_size * (option_.max_disparity - option_.min_disparity);
+
+	// ׶ִͬУÿ׶νȽ׶λḴòֻ棬Ƚϣ
+	for (auto stereo : stereos) {
+		stereo->ComputeCost();
+	}
+	diffs.push_back(CompareCensus(Stage_Cost, "census_left", option_.census_size, cost_computer_.get_census_left_ptr(),
+								  reference.cost_computer_.get_census_left_ptr(), img_size));
+	diffs.push_back(CompareCensus(Stage_Cost, "census_right", option_.census_size, cost_computer_.get_census_right_ptr(),
+								  reference.cost_computer_.get_census_right_ptr(), img_size));
+	diffs.push_back(CompareFloat(Stage_Cost, "cost_init", cost_computer_.get_cost_ptr(),
+								 reference.cost_computer_.get_cost_ptr(), vol_size));
+
+	for (auto stereo : stereos) {
+		stereo->CostAggregation();
+	}
+	diffs.push_back(CompareArms(Stage_Aggregation, "cross_arms", aggregator_.get_arms_ptr(),
+								reference.aggregator_.get_arms_ptr(), img_size));
+	diffs.push_back(CompareFloat(Stage_Aggregation, "cost_aggr", aggregator_.get_cost_ptr(),
+								 reference.aggregator_.get_cost_ptr(), vol_size));
+
+	for (auto stereo : stereos) {
+		stereo->ScanlineOptimize();
+	}
+	diffs.push_back(CompareFloat(Stage_Scanline, "cost_so", aggregator_.get_cost_ptr(),
+								 reference.aggregator_.get_cost_ptr(), vol_size));
+
+	for (auto stereo : stereos) {
+		stereo->ComputeDisparity();
+		if (!option_.lazy_right_disparity) {
+			stereo->ComputeDisparityRight();
+		}
+	}
+	diffs.push_back(CompareFloat(Stage_Disparity, "disp_left", disp_left_, reference.disp_left_, img_size));
+	if (!option_.lazy_right_disparity) {
+		diffs.push_back(CompareFloat(Stage_Disparity, "disp_right", disp_right_, reference.disp_right_, img_size));
+	}
+
+	for (auto stereo : stereos) {
+		stereo->MultiStepRefine();
+	}
+	diffs.push_back(CompareFloat(Stage_Refine, "disp_refined", disp_left_, reference.disp_left_, img_size));
+
+	return true;
+}
+
+bool ADCensusStereo::Reset(const uint32& width, const uint32& height, const ADCensusOption& option)
+{
+	// ãڴ㹻ʱ·
+	return Reconfigure(width, height, option);
 }
 
 
 void ADCensusStereo::ComputeCost()
 {
+	ADCENSUS_TRACE_SCOPE("Stage:Cost");
 	// ôۼ
 	cost_computer_.SetData(img_left_, img_right_);
 	// ôۼ
-	cost_computer_.SetParams(option_.lambda_ad, option_.lambda_census);
+	cost_computer_.SetParams(option_.lambda_ad, option_.lambda_census, option_.census_size, option_.grayscale);
 	// 
 	cost_computer_.Compute();
+	// Ҷģʽº׶ξȡۼɵĻҶӰ
+	if (option_.grayscale) {
+		img_left_ = ADImageView(cost_computer_.get_gray_left_ptr(), width_, Pixel_Gray);
+		img_right_ = ADImageView(cost_computer_.get_gray_right_ptr(), width_, Pixel_Gray);
+	}
+}
+
+void ADCensusStereo::ComputeColorDiffs()
+{
+	ADCENSUS_TRACE_SCOPE("ComputeColorDiffs");
+	adcensus_util::ComputeNeighborDiffs(img_left_, width_, height_, diff_left_h_, diff_left_v_);
+	adcensus_util::ComputeNeighborDiffs(img_right_, width_, height_, diff_right_h_, diff_right_v_);
 }
 
 void ADCensusStereo::CostAggregation()
 {
+	ADCENSUS_TRACE_SCOPE("Stage:Aggregation");
+	// صɫͼۺϽ׶
+	ComputeColorDiffs();
 	// þۺ
 	aggregator_.SetData(img_left_, img_right_, cost_computer_.get_cost_ptr());
+	aggregator_.SetColorDiffs(diff_left_h_, diff_left_v_);
 	// þۺ
-	aggregator_.SetParams(option_.cross_L1, option_.cross_L2, option_.cross_t1, option_.cross_t2);
+	aggregator_.SetParams(option_.cross_L1, option_.cross_L2,
+						  ColorThreshold(option_.cross_t1, img_left_.format), ColorThreshold(option_.cross_t2, img_left_.format));
 	// ۾ۺ
-	aggregator_.Aggregate(4);
+	aggregator_.Aggregate(option_.aggr_iters, option_.aggr_converge_ratio);
 }
 
 void ADCensusStereo::ScanlineOptimize()
 {
+	ADCENSUS_TRACE_SCOPE("Stage:Scanline");
 	// Ż
 	scan_line_.SetData(img_left_, img_right_, cost_computer_.get_cost_ptr(), aggregator_.get_cost_ptr());
+	scan_line_.SetColorDiffs(diff_left_h_, diff_left_v_, diff_right_h_, diff_right_v_);
 	// Ż
-	scan_line_.SetParam(width_, height_, option_.min_disparity, option_.max_disparity, option_.so_p1, option_.so_p2, option_.so_tso);
+	scan_line_.SetParam(width_, height_, option_.min_disparity, option_.max_disparity, option_.so_p1, option_.so_p2,
+						ColorThreshold(option_.so_tso, img_left_.format));
 	// ɨŻ
 	scan_line_.Optimize();
 }
 
 void ADCensusStereo::MultiStepRefine()
 {
+	ADCENSUS_TRACE_SCOPE("Stage:Refine");
 	// öಽŻ
 	refiner_.SetData(img_left_, aggregator_.get_cost_ptr(), aggregator_.get_arms_ptr(), disp_left_, disp_right_);
 	// öಽŻ
 	refiner_.SetParam(option_.min_disparity, option_.max_disparity, option_.irv_ts, option_.irv_th, option_.lrcheck_thres,
-					  option_.do_lr_check,option_.do_filling,option_.do_filling, option_.do_discontinuity_adjustment);
+					  option_.do_lr_check,option_.do_filling,option_.do_filling, option_.do_discontinuity_adjustment, option_.lazy_right_disparity);
 	// ಽŻ
 	refiner_.Refine();
 }
 
 void ADCensusStereo::ComputeDisparity()
 {
+	ADCENSUS_TRACE_SCOPE("ComputeDisparity");
 	const sint32& min_disparity = option_.min_disparity;
 	const sint32& max_disparity = option_.max_disparity;
 	const sint32 disp_range = max_disparity - min_disparity;
@@ -244,6 +694,7 @@ void ADCensusStereo::ComputeDisparity()
 
 void ADCensusStereo::ComputeDisparityRight()
 {
+	ADCENSUS_TRACE_SCOPE("ComputeDisparityRight");
 	const sint32& min_disparity = option_.min_disparity;
 	const sint32& max_disparity = option_.max_disparity;
 	const sint32 disp_range = max_disparity - min_disparity;
@@ -267,51 +718,17 @@ void ADCensusStereo::ComputeDisparityRight()
 	// cost(xr,yr,d) = cost(xr+d,yl,d)
 	for (sint32 i = 0; i < height; i++) {
 		for (sint32 j = 0; j < width; j++) {
-			float32 min_cost = Large_Float;
-			sint32 best_disparity = 0;
-
-			// ---ͳƺѡӲµĴֵ
-			for (sint32 d = min_disparity; d < max_disparity; d++) {
-				const sint32 d_idx = d - min_disparity;
-				const sint32 col_left = j + d;
-				if (col_left >= 0 && col_left < width) {
-					const auto& cost = cost_local[d_idx] = cost_ptr[i * width * disp_range + col_left * disp_range + d_idx];
-					if (min_cost > cost) {
-						min_cost = cost;
-						best_disparity = d;
-					}
-				}
-				else {
-					cost_local[d_idx] = Large_Float;
-				}
-			}
-
-			// ---
-			if (best_disparity == min_disparity || best_disparity == max_disparity - 1) {
-				disparity[i * width + j] = best_disparity;
-				continue;
-			}
-
-			// ӲǰһӲĴֵcost_1һӲĴֵcost_2
-			const sint32 idx_1 = best_disparity - 1 - min_disparity;
-			const sint32 idx_2 = best_disparity + 1 - min_disparity;
-			const float32 cost_1 = cost_local[idx_1];
-			const float32 cost_2 = cost_local[idx_2];
-			// һԪ߼ֵ
-			const float32 denom = cost_1 + cost_2 - 2 * min_cost;
-			if (denom != 0.0f) {
-				disparity[i * width + j] = static_cast<float32>(best_disparity) + (cost_1 - cost_2) / (denom * 2.0f);
-			}
-			else {
-				disparity[i * width + j] = static_cast<float32>(best_disparity);
-			}
+			disparity[i * width + j] = adcensus_util::ComputeRightDisparity(cost_ptr, width, min_disparity, max_disparity, i, j, &cost_local[0]);
 		}
 	}
 }
 
 void ADCensusStereo::Release()
 {
-	SAFE_DELETE(disp_left_);
-	SAFE_DELETE(disp_right_);
+	arena_.Release();
+	disp_left_ = nullptr;
+	disp_left_buffer_ = nullptr;
+	disp_right_ = nullptr;
+	diff_left_h_ = diff_left_v_ = diff_right_h_ = diff_right_v_ = nullptr;
 }
 
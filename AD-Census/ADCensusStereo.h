@@ -10,6 +10,9 @@
 #include "cross_aggregator.h"
 #include "scanline_optimizer.h"
 #include "multistep_refiner.h"
+#include "memory_arena.h"
+#include "perf_counters.h"
+#include <vector>
 
 class ADCensusStereo {	
 public:
@@ -29,8 +32,18 @@ public:
 	* \param img_left	룬Ӱָ룬3ͨɫ
 	* \param img_right	룬Ӱָ룬3ͨɫ
 	* \param disp_left	ӰӲͼָ룬ԤȷӰȳߴڴռ
+	* \param stats		ƥͳϢ׶κʱô߳ŻؼΪnullptrʱκͳ
 	*/
-	bool Match(const uint8* img_left, const uint8* img_right, float32* disp_left);
+	bool Match(const uint8* img_left, const uint8* img_right, float32* disp_left, ADCensusStats* stats = nullptr);
+
+	/**
+	* \brief ִƥ䣬ӰӲͼͼ׶ֱӶȡ÷ڴ棨пȼظʽӰ
+	* \param img_left	룬Ӱͼ
+	* \param img_right	룬Ӱͼ
+	* \param disp_left	ӰӲͼͼմ洢ʱˮֱϼ㣬д
+	* \param stats		ƥͳϢΪnullptrʱκͳ
+	*/
+	bool Match(const ADImageView& img_left, const ADImageView& img_right, const ADDisparityView& disp_left, ADCensusStats* stats = nullptr);
 
 	/**
 	* \brief 
@@ -40,10 +53,99 @@ public:
 	*/
 	bool Reset(const uint32& width, const uint32& height, const ADCensusOption& option);
 
+	/**
+	* \brief óߴڴ㹻ʱڴ棬·
+	* \param width		룬Ӱ
+	* \param height		룬Ӱ
+	* \param option		룬㷨
+	*/
+	bool Reconfigure(const sint32& width, const sint32& height, const ADCensusOption& option);
+
+	/**
+	* \brief ߴڴصĹ滮ֵֽڣʵʷڴ
+	* \param width		룬Ӱ
+	* \param height		룬Ӱ
+	* \param option		룬㷨
+	* \return ֵڴֽЧʱ0
+	*/
+	static size_t PlanMemoryFootprint(const sint32& width, const sint32& height, const ADCensusOption& option);
+
+	/**
+	* \brief ȡĳһ׶ʵִеļˣѡڸý׶δעʵʱΪBackend_Reference
+	* \param stage		룬׶
+	*/
+	ADCensusBackend get_backend(const ADCensusStage& stage) const;
+
+	/**
+	* \brief УģʽԵǰοʵ֣Backend_Referenceڶʵ׶ִͬͬһԣ
+	*		  Ƚϸ׶εм仺棨censusʼۡۡۺϴۡɨŻۡӲͼŻӲͼ
+	*		  Ҫڴ棬ڵԼ֤Żʵ
+	* \param img_left	룬Ӱָ룬3ͨɫ
+	* \param img_right	룬Ӱָ룬3ͨɫ
+	* \param diffs		׶˳еĸ
+	* \return true: ʵִгɹһ£
+	*/
+	bool Verify(const uint8* img_left, const uint8* img_right, std::vector<ADCensusBufferDiff>& diffs);
+
+	/**
+	* \brief УģʽӰͼ
+	* \param img_left	룬Ӱͼ
+	* \param img_right	룬Ӱͼ
+	* \param diffs		׶˳еĸ
+	*/
+	bool Verify(const ADImageView& img_left, const ADImageView& img_right, std::vector<ADCensusBufferDiff>& diffs);
+
 private:
+	/** \brief ڴеĻ */
+	enum BufferBlock {
+		Block_GrayLeft = 0,
+		Block_GrayRight,
+		Block_CensusLeft,
+		Block_CensusRight,
+		Block_CostInit,
+		Block_DiffLeftH,
+		Block_DiffLeftV,
+		Block_DiffRightH,
+		Block_DiffRightV,
+		Block_CrossArms,
+		Block_CostAggr,
+		Block_CostTmp0,
+		Block_CostTmp1,
+		Block_SupCount0,
+		Block_SupCount1,
+		Block_SupCountTmp,
+		Block_Labels,
+		Block_RayMap,
+		Block_DispLeft,
+		Block_DispRight,
+		Block_Count
+	};
+
+	/**
+	* \brief ڹ滮
+	* \param width		룬Ӱ
+	* \param height		룬Ӱ
+	* \param option		룬㷨
+	* \param planner		ڴ滮Block_Count
+	* \return true: Ч
+	*/
+	static bool PlanBuffers(const sint32& width, const sint32& height, const ADCensusOption& option, MemoryPlanner& planner);
+
+	/** \brief д׶Ҫķô㷨ģʽ㣩 */
+	void ComputeStageBytes(ADCensusStats* stats) const;
+
+	/** \brief ڴлָ飬øģ */
+	bool AllocateBuffers();
+
+	/** \brief ȷ׶εļˣøģ */
+	bool SelectBackends();
+
 	/** \brief ۼ */
 	void ComputeCost();
 
+	/** \brief Ӱصɫͼ۹ɨŻ */
+	void ComputeColorDiffs();
+
 	/** \brief ۾ۺ */
 	void CostAggregation();
 
@@ -62,6 +164,9 @@ private:
 	/** \brief ڴͷ */
 	void Release();
 
+	/** \brief ӰͼǷЧǿп㹻 */
+	bool CheckView(const ADImageView& view) const;
+
 private:
 	/** \brief 㷨 */
 	ADCensusOption option_;
@@ -71,10 +176,10 @@ private:
 	/** \brief Ӱ */
 	sint32 height_;
 
-	/** \brief Ӱݣ3ͨɫ */
-	const uint8* img_left_;
-	/** \brief Ӱ	3ͨɫ */
-	const uint8* img_right_;
+	/** \brief Ӱͼ */
+	ADImageView img_left_;
+	/** \brief Ӱͼ */
+	ADImageView img_right_;
 
 	/** \brief ۼ */
 	CostComputor cost_computer_;
@@ -85,11 +190,28 @@ private:
 	/** \brief ಽŻ */
 	MultiStepRefiner refiner_;
 
-	/** \brief ӰӲͼ */
+	/** \brief ڴأд弰мݾл */
+	MemoryArena arena_;
+
+	/** \brief Ӳܼprofile_hw_countersʱ״ƥ */
+	PerfCounters perf_counters_;
+
+	/** \brief ӰӲͼͼմ洢ʱƥڼָ÷ڴ */
 	float32* disp_left_;
+	/** \brief ڴеӰӲͼ */
+	float32* disp_left_buffer_;
 	/** \brief ӰӲͼ */
 	float32* disp_right_;
 
+	/** \brief ӰصɫͼˮƽأֱϷأ */
+	uint8* diff_left_h_;
+	uint8* diff_left_v_;
+	uint8* diff_right_h_;
+	uint8* diff_right_v_;
+
+	/** \brief ׶ʵִеļ */
+	ADCensusBackend backends_[Stage_Count];
+
 	/** \brief Ƿʼ־	*/
 	bool is_initialized_;
 };
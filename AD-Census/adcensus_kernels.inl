@@ -0,0 +1,507 @@
+/* -*-c++-*- AD-Census - Copyright (C) 2020.
+* Author	: Yingsong Li(Ethan Li) <ethan.li.whu@gmail.com>
+* https://github.com/ethan-li-coding/AD-Census
+* Describe	: kernels shared by all instruction set levels
+*/
+
+// ļadcensus_kernels_*.cppÿ뵥ԪԲָͬѡͬһݴ룺
+//   ADCENSUS_KERNEL_BIND	õԪĺ󶨺
+//   ADCENSUS_KERNEL_POPCNT	ʱʹӲpopcntָ
+// ӲΧصںģDػõӲΧ64128256ѭΪڳԱȫչ
+// DΪ0ʱΪʱӲΧͨʵ
+// ں˾ռ䣬Ҳͷļеģ壨std::minstd::sort
+// Ը߼ָʵѡõ뵥Ԫڲֵ֧CPUִ
+
+#ifndef ADCENSUS_KERNEL_BIND
+#error "ADCENSUS_KERNEL_BIND must be defined before including adcensus_kernels.inl"
+#endif
+
+namespace
+{
+	using adcensus_util::ExpValue;
+
+	/** \brief ͬstd::minʱa */
+	inline float32 Min(const float32& a, const float32& b)
+	{
+		return (b < a) ? b : a;
+	}
+
+	/** \brief ӰyصַͬADImageView::pixel(0, y)ڱԪڼͷļеԱ */
+	inline const uint8* ImageRow(const ADImageView& img, const sint32& y)
+	{
+		return img.data + static_cast<sint64>(y) * img.stride;
+	}
+
+	/** \brief 32λ1ĸ */
+	inline sint32 PopCount(uint32 x)
+	{
+#if defined(ADCENSUS_KERNEL_POPCNT) && defined(_MSC_VER)
+		return static_cast<sint32>(__popcnt(x));
+#elif defined(ADCENSUS_KERNEL_POPCNT)
+		return __builtin_popcount(x);
+#else
+		x = x - ((x >> 1) & 0x55555555u);
+		x = (x & 0x33333333u) + ((x >> 2) & 0x33333333u);
+		x = (x + (x >> 4)) & 0x0f0f0f0fu;
+		return static_cast<sint32>((x * 0x01010101u) >> 24);
+#endif
+	}
+
+	/** \brief 64λ1ĸ */
+	inline sint32 PopCount(uint64 x)
+	{
+#if defined(ADCENSUS_KERNEL_POPCNT) && defined(_MSC_VER)
+		return static_cast<sint32>(__popcnt64(x));
+#elif defined(ADCENSUS_KERNEL_POPCNT)
+		return __builtin_popcountll(x);
+#else
+		// 鲢м޷֧
+		x = x - ((x >> 1) & 0x5555555555555555ull);
+		x = (x & 0x3333333333333333ull) + ((x >> 2) & 0x3333333333333333ull);
+		x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0full;
+		return static_cast<sint32>((x * 0x0101010101010101ull) >> 56);
+#endif
+	}
+
+	/** \brief бػʱȡػӲΧȡʱֵ */
+	template <sint32 D>
+	inline sint32 DispRange(const sint32& disp_range)
+	{
+		return (D > 0) ? D : disp_range;
+	}
+
+	/**
+	 * \brief census任Ϊ(2*RY+1)(2*RX+1)
+	 * \tparam RY/RX	ڵСа뾶
+	 * \tparam CensusT	censusֵͣλڴ
+	 */
+	template <sint32 RY, sint32 RX, typename CensusT>
+	void CensusTransform(const uint8* source, CensusT* census, const sint32& width, const sint32& height)
+	{
+		static_assert((2 * RY + 1) * (2 * RX + 1) <= static_cast<sint32>(8 * sizeof(CensusT)), "census window exceeds census type");
+		if (source == nullptr || census == nullptr || width <= 0 || height <= 0) {
+			return;
+		}
+
+		// 任ı߽0СӰжοʵͬ
+		if (width <= 2 * RY + 1 || height <= 2 * RX + 1) {
+			memset(census, 0, width * height * sizeof(CensusT));
+			return;
+		}
+		memset(census, 0, RY * width * sizeof(CensusT));
+		memset(census + (height - RY) * width, 0, RY * width * sizeof(CensusT));
+
+#pragma omp parallel for schedule(static)
+		for (sint32 i = RY; i < height - RY; i++) {
+			CensusT* census_row = census + i * width;
+			for (sint32 j = 0; j < RX; j++) {
+				census_row[j] = 0u;
+				census_row[width - 1 - j] = 0u;
+			}
+			// бȽϣȽϽοʵֵλ򣨴ȣϽΪλƴ
+			for (sint32 j = RX; j < width - RX; j++) {
+				const uint8 gray_center = source[i * width + j];
+				CensusT census_val = 0u;
+				for (sint32 r = -RY; r <= RY; r++) {
+					const uint8* src = source + (i + r) * width + j - RX;
+					for (sint32 c = 0; c < 2 * RX + 1; c++) {
+						census_val = static_cast<CensusT>((census_val << 1) | static_cast<CensusT>(src[c] < gray_center));
+					}
+				}
+				census_row[j] = census_val;
+			}
+		}
+	}
+
+	template <typename CensusT>
+	uint8 HammingDistance(const CensusT& x, const CensusT& y)
+	{
+		return static_cast<uint8>(PopCount(x ^ y));
+	}
+
+	/** \brief дۣӰΪҶȣͬľֵ֮Ϊͨ3ÿֻ1ֽ */
+	template <sint32 D, typename CensusT>
+	void CostRowGray(const ADImageView& img_left, const ADImageView& img_right, const sint32& y,
+					 const CensusT* census_row_l, const CensusT* census_row_r,
+					 const sint32& width, const sint32& min_disparity, const sint32& max_disparity,
+					 const ExpValue* exp_ad, const ExpValue* exp_census, float32* cost_row)
+	{
+		const sint32 disp_range = DispRange<D>(max_disparity - min_disparity);
+		const uint8* img_row_l = ImageRow(img_left, y);
+		const uint8* img_row_r = ImageRow(img_right, y);
+		for (sint32 x = 0; x < width; x++) {
+			const sint32 gray_l = img_row_l[x];
+			const CensusT census_val_l = census_row_l[x];
+			float32* cost = cost_row + x * disp_range;
+
+			const sint32 x0 = x - min_disparity;
+			const sint32 k_begin = (x0 - width + 1 > 0) ? ((x0 - width + 1 < disp_range) ? x0 - width + 1 : disp_range) : 0;
+			const sint32 k_end = (x0 + 1 < disp_range) ? ((x0 + 1 > k_begin) ? x0 + 1 : k_begin) : disp_range;
+			for (sint32 k = 0; k < k_begin; k++) {
+				cost[k] = 1.0f;
+			}
+			for (sint32 k = k_begin; k < k_end; k++) {
+				const sint32 xr = x0 - k;
+				const sint32 diff = gray_l - img_row_r[xr];
+				const sint32 ham = PopCount(static_cast<CensusT>(census_val_l ^ census_row_r[xr]));
+				cost[k] = 1 - exp_ad[3 * (diff < 0 ? -diff : diff)] + 1 - exp_census[ham];
+			}
+			for (sint32 k = k_end; k < disp_range; k++) {
+				cost[k] = 1.0f;
+			}
+		}
+	}
+
+	template <sint32 D, typename CensusT>
+	void CostRow(const ADImageView& img_left, const ADImageView& img_right, const sint32& y,
+				 const CensusT* census_row_l, const CensusT* census_row_r,
+				 const sint32& width, const sint32& min_disparity, const sint32& max_disparity,
+				 const ExpValue* exp_ad, const ExpValue* exp_census, float32* cost_row)
+	{
+		if (img_left.format == Pixel_Gray && img_right.format == Pixel_Gray) {
+			CostRowGray<D>(img_left, img_right, y, census_row_l, census_row_r, width, min_disparity, max_disparity,
+						   exp_ad, exp_census, cost_row);
+			return;
+		}
+		const sint32 disp_range = DispRange<D>(max_disparity - min_disparity);
+		const uint8* img_row_l = ImageRow(img_left, y);
+		const uint8* img_row_r = ImageRow(img_right, y);
+		const sint32 step_l = img_left.pixel_step, step_r = img_right.pixel_step;
+		const sint32 bl = img_left.channel[0], gl = img_left.channel[1], rl = img_left.channel[2];
+		const sint32 br = img_right.channel[0], gr = img_right.channel[1], rr = img_right.channel[2];
+		for (sint32 x = 0; x < width; x++) {
+			const uint8* pl = img_row_l + step_l * x;
+			const CensusT census_val_l = census_row_l[x];
+			float32* cost = cost_row + x * disp_range;
+
+			// ͬxr = x - min_disparity - kλӰڵӲΪ[k_begin, k_end)Ϊ1
+			const sint32 x0 = x - min_disparity;
+			const sint32 k_begin = (x0 - width + 1 > 0) ? ((x0 - width + 1 < disp_range) ? x0 - width + 1 : disp_range) : 0;
+			const sint32 k_end = (x0 + 1 < disp_range) ? ((x0 + 1 > k_begin) ? x0 + 1 : k_begin) : disp_range;
+			for (sint32 k = 0; k < k_begin; k++) {
+				cost[k] = 1.0f;
+			}
+			for (sint32 k = k_begin; k < k_end; k++) {
+				const sint32 xr = x0 - k;
+				const uint8* pr = img_row_r + step_r * xr;
+				const sint32 d0 = pl[bl] - pr[br], d1 = pl[gl] - pr[gr], d2 = pl[rl] - pr[rr];
+				const sint32 sad = (d0 < 0 ? -d0 : d0) + (d1 < 0 ? -d1 : d1) + (d2 < 0 ? -d2 : d2);
+				const sint32 ham = PopCount(static_cast<CensusT>(census_val_l ^ census_row_r[xr]));
+				cost[k] = 1 - exp_ad[sad] + 1 - exp_census[ham];
+			}
+			for (sint32 k = k_end; k < disp_range; k++) {
+				cost[k] = 1.0f;
+			}
+		}
+	}
+
+	template <sint32 D>
+	void Accumulate(float32* dst, const float32* src, const sint32& n)
+	{
+		const sint32 num = DispRange<D>(n);
+		for (sint32 i = 0; i < num; i++) {
+			dst[i] += src[i];
+		}
+	}
+
+	template <sint32 D>
+	void Divide(float32* dst, const float32& count, const sint32& n)
+	{
+		const sint32 num = DispRange<D>(n);
+		for (sint32 i = 0; i < num; i++) {
+			dst[i] = dst[i] / count;
+		}
+	}
+
+	/** \brief ɨŻӲľۺϣprevnextΪ·ϸӲľۺϴ */
+	inline float32 ScanlineOne(const float32& cost, const float32& l1, const float32& prev, const float32& next,
+							   const float32& P1, const float32& l4, float32& out)
+	{
+		float32 cost_s = cost + Min(Min(l1, prev + P1), Min(next + P1, l4));
+		cost_s /= 2;
+		out = cost_s;
+		return cost_s;
+	}
+
+	template <sint32 D>
+	float32 ScanlineStep(const float32* cost, const float32* last, const float32& min_last, const uint8* edge_r,
+						 const float32* p1, const float32* p2, float32* out, const sint32& disp_range)
+	{
+		// Lr(p,d) = C(p,d) + min( Lr(p-r,d), Lr(p-r,d-1) + P1, Lr(p-r,d+1) + P1, min(Lr(p-r))+P2 )ٳ2
+		// ӲΧβΪLarge_FloatοʵֵڱԪһ£βм䲿޷֧
+		const float32 l4[2] = { min_last + p2[0], min_last + p2[1] };
+		const sint32 last_d = DispRange<D>(disp_range) - 1;
+		if (last_d == 0) {
+			return ScanlineOne(cost[0], last[0], Large_Float, Large_Float, p1[edge_r[0]], l4[edge_r[0]], out[0]);
+		}
+		float32 min_cost = ScanlineOne(cost[0], last[0], Large_Float, last[1], p1[edge_r[0]], l4[edge_r[0]], out[0]);
+		for (sint32 d = 1; d < last_d; d++) {
+			const sint32 e = edge_r[d];
+			min_cost = Min(min_cost, ScanlineOne(cost[d], last[d], last[d - 1], last[d + 1],
+												 e ? p1[1] : p1[0], e ? l4[1] : l4[0], out[d]));
+		}
+		return Min(min_cost, ScanlineOne(cost[last_d], last[last_d], last[last_d - 1], Large_Float,
+										 p1[edge_r[last_d]], l4[edge_r[last_d]], out[last_d]));
+	}
+
+	/** \brief ڲüӰΧڵĵֵ򣩣falseʾΪ */
+	inline bool MedianPixel(const float32* in, const sint32& width, const sint32& height, const sint32& radius,
+							const sint32& x, const sint32& y, float32* wnd_data, float32& median)
+	{
+		sint32 num = 0;
+		for (sint32 r = -radius; r <= radius; r++) {
+			const sint32 row = y + r;
+			if (row < 0 || row >= height) {
+				continue;
+			}
+			for (sint32 c = -radius; c <= radius; c++) {
+				const sint32 col = x + c;
+				if (col < 0 || col >= width) {
+					continue;
+				}
+				const float32 val = in[row * width + col];
+				sint32 k = num++;
+				for (; k > 0 && val < wnd_data[k - 1]; k--) {
+					wnd_data[k] = wnd_data[k - 1];
+				}
+				wnd_data[k] = val;
+			}
+		}
+		if (num == 0) {
+			return false;
+		}
+		median = wnd_data[num / 2];
+		return true;
+	}
+
+	/** \brief ͬstd::maxʱa */
+	inline float32 Max(const float32& a, const float32& b)
+	{
+		return (a < b) ? b : a;
+	}
+
+	/** \brief ֵ */
+	inline float32 Median3(const float32& a, const float32& b, const float32& c)
+	{
+		return Max(Min(a, b), Min(Max(a, b), c));
+	}
+
+	/** \brief ԪرȽϽһȽУaȡСֵbȡϴֵ */
+	inline void SortPair(float32* a, float32* b, const sint32& n)
+	{
+		for (sint32 i = 0; i < n; i++) {
+			const float32 lo = Min(a[i], b[i]);
+			const float32 hi = Max(a[i], b[i]);
+			a[i] = lo;
+			b[i] = hi;
+		}
+	}
+
+	/** \brief ֵ˲зֿĿڵʱջ */
+	const sint32 median_chunk = 64;
+
+	/**
+	 * \brief 3x3ֵ˲ڲأ߽粻С1outinͬ
+	 * ÿе3ֵ3Ƚ9ֵֵΪ3Сֵеֵ3ֵֵ3ֵеСֵߵֵ
+	 */
+	void Median3x3Rows(const float32* in, float32* out, const sint32& width, const sint32& height)
+	{
+		float32 lo[median_chunk + 2], mid[median_chunk + 2], hi[median_chunk + 2];
+		for (sint32 y = 1; y < height - 1; y++) {
+			const float32* row0 = in + (y - 1) * width;
+			const float32* row1 = in + y * width;
+			const float32* row2 = in + (y + 1) * width;
+			float32* out_row = out + y * width;
+			for (sint32 x0 = 1; x0 < width - 1; x0 += median_chunk) {
+				const sint32 n = (width - 1 - x0 < median_chunk) ? (width - 1 - x0) : median_chunk;
+				// 򣬿nعn+2
+				for (sint32 i = 0; i < n + 2; i++) {
+					lo[i] = row0[x0 - 1 + i];
+					mid[i] = row1[x0 - 1 + i];
+					hi[i] = row2[x0 - 1 + i];
+				}
+				SortPair(lo, mid, n + 2);
+				SortPair(mid, hi, n + 2);
+				SortPair(lo, mid, n + 2);
+				for (sint32 i = 0; i < n; i++) {
+					const float32 a = Max(Max(lo[i], lo[i + 1]), lo[i + 2]);
+					const float32 b = Median3(mid[i], mid[i + 1], mid[i + 2]);
+					const float32 c = Min(Min(hi[i], hi[i + 1]), hi[i + 2]);
+					out_row[x0 + i] = Median3(a, b, c);
+				}
+			}
+		}
+	}
+
+	/**
+	 * \brief 5x5ֵ˲ڲأ߽粻С2outinͬ
+	 * ѡȡ14ֵȥСֵֵһֱֵ25ֵѲ룬ʣ3ֵֵΪ25ֵֵ
+	 * СֵֵеðݱȽѡݣ
+	 */
+	void Median5x5Rows(const float32* in, float32* out, const sint32& width, const sint32& height)
+	{
+		const sint32 num_wnd = 25;
+		const sint32 num_keep = num_wnd / 2 + 2;
+		float32 work[num_keep][median_chunk];
+		for (sint32 y = 2; y < height - 2; y++) {
+			for (sint32 x0 = 2; x0 < width - 2; x0 += median_chunk) {
+				const sint32 n = (width - 2 - x0 < median_chunk) ? (width - 2 - x0) : median_chunk;
+				// ڵjֵȣ׵ַ
+				const auto wnd_row = [&](const sint32& j) {
+					return in + (y + j / 5 - 2) * width + x0 + j % 5 - 2;
+				};
+				for (sint32 j = 0; j < num_keep; j++) {
+					const float32* src = wnd_row(j);
+					for (sint32 i = 0; i < n; i++) {
+						work[j][i] = src[i];
+					}
+				}
+				sint32 m = num_keep;
+				for (sint32 next = num_keep; ; next++) {
+					// ֵwork[m-1]Сֵwork[0]
+					for (sint32 k = 0; k < m - 1; k++) {
+						SortPair(work[k], work[k + 1], n);
+					}
+					for (sint32 k = m - 3; k >= 0; k--) {
+						SortPair(work[k], work[k + 1], n);
+					}
+					if (next == num_wnd) {
+						break;
+					}
+					// һֵСֵֵ
+					const float32* src = wnd_row(next);
+					for (sint32 i = 0; i < n; i++) {
+						work[0][i] = src[i];
+					}
+					m--;
+				}
+				float32* out_row = out + y * width + x0;
+				for (sint32 i = 0; i < n; i++) {
+					out_row[i] = work[1][i];
+				}
+			}
+		}
+	}
+
+	/** \brief ͬabs */
+	inline float32 Abs(const float32& v)
+	{
+		return (v < 0.0f) ? -v : v;
+	}
+
+	/** \brief ԵķֿСѭΪڳGCC-O2Ϳģͣ */
+	const sint32 Sobel_Block = 32;
+
+	/** \brief xеsobelԵǣEdgeDetectͬ2Ϊȷ㣬ںϳ˼಻ı޷֧ */
+	inline uint8 SobelPixel(const float32* __restrict row0, const float32* __restrict row1, const float32* __restrict row2,
+							const sint32 x, const float32 threshold)
+	{
+		const float32 grad_x = (-row0[x - 1] + row0[x + 1]) + (-2 * row1[x - 1] + 2 * row1[x + 1]) + (-row2[x - 1] + row2[x + 1]);
+		const float32 grad_y = (-row0[x - 1] - 2 * row0[x] - row0[x + 1]) + (row2[x - 1] + 2 * row2[x] + row2[x + 1]);
+		return static_cast<uint8>(Abs(grad_x) + Abs(grad_y) > threshold);
+	}
+
+	void SobelEdge(const float32* __restrict row0, const float32* __restrict row1, const float32* __restrict row2, const sint32& width,
+				   const float32& threshold, uint8* __restrict edge)
+	{
+		// ȼֵΪֲָΪصedgeдܸдwidthѭԤ֪
+		const sint32 w = width;
+		const float32 t = threshold;
+		if (w <= 0) {
+			return;
+		}
+		edge[0] = edge[w - 1] = 0;
+		sint32 x = 1;
+		for (; x + Sobel_Block <= w - 1; x += Sobel_Block) {
+			for (sint32 k = 0; k < Sobel_Block; k++) {
+				edge[x + k] = SobelPixel(row0, row1, row2, x + k, t);
+			}
+		}
+		for (; x < w - 1; x++) {
+			edge[x] = SobelPixel(row0, row1, row2, x, t);
+		}
+	}
+
+	void Median(const float32* in, float32* out, const sint32& width, const sint32& height, const sint32 wnd_size)
+	{
+		// ڳ11x11ʱʹòοʵ
+		const sint32 max_wnd = 11;
+		if (wnd_size > max_wnd) {
+			adcensus_util::MedianFilter(in, out, width, height, wnd_size);
+			return;
+		}
+		const sint32 radius = wnd_size / 2;
+		float32 wnd_data[max_wnd * max_wnd];
+		float32 median = 0.0f;
+
+		if (in == out || (wnd_size != 3 && wnd_size != 5)) {
+			// οʵͬо͵˲inoutͬʱȡ˲ֵԲȡֵͬ
+			for (sint32 y = 0; y < height; y++) {
+				for (sint32 x = 0; x < width; x++) {
+					if (MedianPixel(in, width, height, radius, x, y, wnd_data, median)) {
+						out[y * width + x] = median;
+					}
+				}
+			}
+			return;
+		}
+
+		// ڲм㣬߽شڱüԲ
+		if (wnd_size == 3) {
+			Median3x3Rows(in, out, width, height);
+		}
+		else {
+			Median5x5Rows(in, out, width, height);
+		}
+		for (sint32 y = 0; y < height; y++) {
+			const bool border_row = (y < radius || y >= height - radius);
+			for (sint32 x = 0; x < width; x++) {
+				if (!border_row && x == radius) {
+					x = (width - radius > radius) ? width - radius : radius;
+				}
+				if (MedianPixel(in, width, height, radius, x, y, wnd_data, median)) {
+					out[y * width + x] = median;
+				}
+			}
+		}
+	}
+}
+
+namespace
+{
+	/** \brief ӲΧػΪD0Ϊͨãĺ */
+	template <sint32 D>
+	void BindTable(adcensus_util::KernelTable& table)
+	{
+		table.disp_range = D;
+		table.census_9x7 = CensusTransform<4, 3, uint64>;
+		table.census_5x5 = CensusTransform<2, 2, uint32>;
+		table.hamming64 = HammingDistance<uint64>;
+		table.hamming32 = HammingDistance<uint32>;
+		table.cost_row = CostRow<D, uint64>;
+		table.cost_row_5x5 = CostRow<D, uint32>;
+		table.accumulate = Accumulate<D>;
+		table.divide = Divide<D>;
+		table.scanline_step = ScanlineStep<D>;
+		table.median = Median;
+		table.sobel_edge = SobelEdge;
+	}
+}
+
+void adcensus_util::ADCENSUS_KERNEL_BIND(KernelTable& table, const sint32& disp_range)
+{
+	switch (disp_range) {
+	case 64:
+		BindTable<64>(table);
+		break;
+	case 128:
+		BindTable<128>(table);
+		break;
+	case 256:
+		BindTable<256>(table);
+		break;
+	default:
+		BindTable<0>(table);
+		break;
+	}
+}
@@ -0,0 +1,22 @@
+/* -*-c++-*- AD-Census - Copyright (C) 2020.
+* Author	: Yingsong Li(Ethan Li) <ethan.li.whu@gmail.com>
+* https://github.com/ethan-li-coding/AD-Census
+* Describe	: kernels for AVX-512
+*/
+
+#include "adcensus_util.h"
+#include <cstring>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// GCC/ClangԺĿָ뱾ԪMSVCڹΪļ/arch:AVX512FMAԱ֤οʵλһ
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#pragma GCC target("avx512f,avx512bw,avx512vl,avx2,popcnt")
+#endif
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64)
+#define ADCENSUS_KERNEL_POPCNT
+#endif
+
+#define ADCENSUS_KERNEL_BIND BindKernelsAVX512
+#include "adcensus_kernels.inl"
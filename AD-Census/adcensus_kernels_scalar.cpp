@@ -0,0 +1,11 @@
+/* -*-c++-*- AD-Census - Copyright (C) 2020.
+* Author	: Yingsong Li(Ethan Li) <ethan.li.whu@gmail.com>
+* https://github.com/ethan-li-coding/AD-Census
+* Describe	: kernels without instruction set extensions
+*/
+
+#include "adcensus_util.h"
+#include <cstring>
+
+#define ADCENSUS_KERNEL_BIND BindKernelsScalar
+#include "adcensus_kernels.inl"
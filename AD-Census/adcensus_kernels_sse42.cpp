@@ -0,0 +1,22 @@
+/* -*-c++-*- AD-Census - Copyright (C) 2020.
+* Author	: Yingsong Li(Ethan Li) <ethan.li.whu@gmail.com>
+* https://github.com/ethan-li-coding/AD-Census
+* Describe	: kernels for SSE4.2 and popcnt
+*/
+
+#include "adcensus_util.h"
+#include <cstring>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// GCC/ClangԺĿָ뱾ԪMSVC x64SSE4.2ѡ__popcnt64ʹӲpopcnt
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#pragma GCC target("sse4.2,popcnt")
+#endif
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64)
+#define ADCENSUS_KERNEL_POPCNT
+#endif
+
+#define ADCENSUS_KERNEL_BIND BindKernelsSSE42
+#include "adcensus_kernels.inl"
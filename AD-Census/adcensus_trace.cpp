@@ -0,0 +1,151 @@
+/* -*-c++-*- AD-Census - Copyright (C) 2020.
+* Author	: Yingsong Li(Ethan Li) <ethan.li.whu@gmail.com>
+* https://github.com/ethan-li-coding/AD-Census
+* Describe	: implement of adcensus_trace
+*/
+
+#include "adcensus_trace.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+
+namespace
+{
+	/** \brief ʱƬ */
+	struct TraceEvent {
+		const char* name;
+		sint64 begin_ns;
+		sint64 end_ns;
+		sint32 arg;
+	};
+
+	/** \brief ̻߳λ棬߳д */
+	struct ThreadRing {
+		TraceEvent events[adcensus_trace::kRingCapacity];
+		std::atomic<uint64> count;
+		ThreadRing() : count(0) {}
+	};
+
+	std::atomic<bool> g_enabled(false);
+	std::atomic<sint32> g_num_rings(0);
+	std::atomic<ThreadRing*> g_rings[adcensus_trace::kMaxThreads];
+	const auto g_epoch = std::chrono::steady_clock::now();
+
+	thread_local ThreadRing* t_ring = nullptr;
+	thread_local bool t_ring_failed = false;
+
+	/** \brief ȡǰ̵߳Ļλ棬״εʱע */
+	ThreadRing* GetThreadRing()
+	{
+		if (t_ring == nullptr && !t_ring_failed) {
+			const sint32 id = g_num_rings.fetch_add(1);
+			if (id >= adcensus_trace::kMaxThreads) {
+				t_ring_failed = true;
+				return nullptr;
+			}
+			t_ring = new ThreadRing;
+			g_rings[id].store(t_ring, std::memory_order_release);
+		}
+		return t_ring;
+	}
+}
+
+void adcensus_trace::Enable(const bool& enable)
+{
+	g_enabled.store(enable, std::memory_order_relaxed);
+}
+
+bool adcensus_trace::IsEnabled()
+{
+	return g_enabled.load(std::memory_order_relaxed);
+}
+
+void adcensus_trace::Clear()
+{
+	const sint32 num_rings = std::min(g_num_rings.load(), kMaxThreads);
+	for (sint32 i = 0; i < num_rings; i++) {
+		ThreadRing* ring = g_rings[i].load(std::memory_order_acquire);
+		if (ring != nullptr) {
+			ring->count.store(0, std::memory_order_release);
+		}
+	}
+}
+
+sint64 adcensus_trace::NowNs()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - g_epoch).count();
+}
+
+void adcensus_trace::Record(const char* name, const sint64& begin_ns, const sint64& end_ns, const sint32& arg)
+{
+	ThreadRing* ring = GetThreadRing();
+	if (ring == nullptr) {
+		return;
+	}
+	const uint64 n = ring->count.load(std::memory_order_relaxed);
+	TraceEvent& ev = ring->events[n & (kRingCapacity - 1)];
+	ev.name = name;
+	ev.begin_ns = begin_ns;
+	ev.end_ns = end_ns;
+	ev.arg = arg;
+	ring->count.store(n + 1, std::memory_order_release);
+}
+
+void adcensus_trace::Collect(std::vector<Span>& spans)
+{
+	spans.clear();
+	const sint32 num_rings = std::min(g_num_rings.load(), kMaxThreads);
+	for (sint32 tid = 0; tid < num_rings; tid++) {
+		const ThreadRing* ring = g_rings[tid].load(std::memory_order_acquire);
+		if (ring == nullptr) {
+			continue;
+		}
+		const uint64 count = ring->count.load(std::memory_order_acquire);
+		const uint64 begin = count > static_cast<uint64>(kRingCapacity) ? count - kRingCapacity : 0;
+		for (uint64 n = begin; n < count; n++) {
+			const TraceEvent& ev = ring->events[n & (kRingCapacity - 1)];
+			spans.push_back({ ev.name, tid, ev.begin_ns, ev.end_ns, ev.arg });
+		}
+	}
+}
+
+bool adcensus_trace::Dump(const std::string& path)
+{
+	FILE* fp = fopen(path.c_str(), "w");
+	if (fp == nullptr) {
+		return false;
+	}
+
+	fprintf(fp, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+	bool first = true;
+	const sint32 num_rings = std::min(g_num_rings.load(), kMaxThreads);
+	for (sint32 tid = 0; tid < num_rings; tid++) {
+		const ThreadRing* ring = g_rings[tid].load(std::memory_order_acquire);
+		if (ring == nullptr) {
+			continue;
+		}
+
+		// ߳
+		fprintf(fp, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"thread %d\"}}",
+				first ? "" : ",\n", tid, tid);
+		first = false;
+
+		// λдֻkRingCapacityƬ
+		const uint64 count = ring->count.load(std::memory_order_acquire);
+		const uint64 begin = count > static_cast<uint64>(kRingCapacity) ? count - kRingCapacity : 0;
+		for (uint64 n = begin; n < count; n++) {
+			const TraceEvent& ev = ring->events[n & (kRingCapacity - 1)];
+			fprintf(fp, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f",
+					ev.name, tid, ev.begin_ns / 1000.0, (ev.end_ns - ev.begin_ns) / 1000.0);
+			if (ev.arg >= 0) {
+				fprintf(fp, ",\"args\":{\"i\":%d}", ev.arg);
+			}
+			fprintf(fp, "}");
+		}
+	}
+	fprintf(fp, "\n]}\n");
+
+	fclose(fp);
+	return true;
+}
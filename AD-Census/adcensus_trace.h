@@ -0,0 +1,95 @@
+/* -*-c++-*- AD-Census - Copyright (C) 2020.
+* Author	: Yingsong Li(Ethan Li) <ethan.li.whu@gmail.com>
+* https://github.com/ethan-li-coding/AD-Census
+* Describe	: header of adcensus_trace
+*/
+
+#pragma once
+#include <string>
+#include <vector>
+#include "adcensus_types.h"
+
+/**
+ * \brief ʱ׷
+ * ߳̽ʱƬдԵĻλ棨дߣɵΪChrome trace JSON
+ * chrome://tracingPerfettoв鿴׶μ̵߳ʱ
+ * δʱ׷ٺֻһԭӶADCENSUS_NO_TRACEȫ
+ */
+namespace adcensus_trace
+{
+	/** \brief ÿ̻߳λɵƬд󸲸Ƭ */
+	const sint32 kRingCapacity = 1 << 16;
+	/** \brief ¼߳ */
+	const sint32 kMaxThreads = 256;
+
+	/** \brief رռ¼ */
+	void Enable(const bool& enable);
+
+	/** \brief Ƿڼ¼ */
+	bool IsEnabled();
+
+	/** \brief ߳Ѽ¼ƬΣ޼¼ʱã */
+	void Clear();
+
+	/** \brief ǰʱ̣룬ڽ״εã */
+	sint64 NowNs();
+
+	/**
+	 * \brief ¼һʱƬ
+	 * \param name		ƬƣΪַ̬
+	 * \param begin_ns	ʼʱ̣룩
+	 * \param end_ns	ʱ̣룩
+	 * \param arg		ӲţС0ʾ
+	 */
+	void Record(const char* name, const sint64& begin_ns, const sint64& end_ns, const sint32& arg);
+
+	/** \brief Ѽ¼ʱƬ */
+	struct Span {
+		const char* name;	// Ƭ
+		sint32 tid;			// ¼߳ţ״μ¼Ⱥţ
+		sint64 begin_ns;	// ʼʱ̣룩
+		sint64 end_ns;		// ʱ̣룩
+		sint32 arg;			// ӲС0ʾ
+	};
+
+	/**
+	 * \brief ȡ߳Ѽ¼ƬΣ߳ż¼ȺУ޼¼ʱã
+	 * \param spans	ʱƬ
+	 */
+	void Collect(std::vector<Span>& spans);
+
+	/**
+	 * \brief Chrome trace JSON޼¼ʱã
+	 * \param path		ļ·
+	 * \return true: ɹ
+	 */
+	bool Dump(const std::string& path);
+
+	/** \brief ƬΣʱ¼ʼʱ̣ʱдƬ */
+	class ScopedSpan {
+	public:
+		explicit ScopedSpan(const char* name, const sint32& arg = -1)
+			: name_(name), arg_(arg), begin_ns_(IsEnabled() ? NowNs() : -1) { }
+		~ScopedSpan() {
+			if (begin_ns_ >= 0) {
+				Record(name_, begin_ns_, NowNs(), arg_);
+			}
+		}
+	private:
+		const char* name_;
+		sint32 arg_;
+		sint64 begin_ns_;
+	};
+}
+
+#define ADCENSUS_TRACE_CONCAT_(a, b) a##b
+#define ADCENSUS_TRACE_CONCAT(a, b) ADCENSUS_TRACE_CONCAT_(a, b)
+#ifndef ADCENSUS_NO_TRACE
+/** \brief ׷ٵǰ */
+#define ADCENSUS_TRACE_SCOPE(name) adcensus_trace::ScopedSpan ADCENSUS_TRACE_CONCAT(trace_span_, __LINE__)(name)
+/** \brief ׷ٵǰ򣬸 */
+#define ADCENSUS_TRACE_SCOPE_ARG(name, arg) adcensus_trace::ScopedSpan ADCENSUS_TRACE_CONCAT(trace_span_, __LINE__)(name, arg)
+#else
+#define ADCENSUS_TRACE_SCOPE(name)
+#define ADCENSUS_TRACE_SCOPE_ARG(name, arg)
+#endif
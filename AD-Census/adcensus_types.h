@@ -7,7 +7,9 @@
 #ifndef ADCENSUS_STEREO_TYPES_H_
 #define ADCENSUS_STEREO_TYPES_H_
 
+#include <algorithm>
 #include <cstdint>
+#include <cstdlib>
 #include <limits>
 #include <vector>
 using std::vector;
@@ -41,6 +43,25 @@ enum CensusSize {
 	Census9x7
 };
 
+/** \brief ƥˮ߽׶ */
+enum ADCensusStage {
+	Stage_Cost = 0,			// ۼ
+	Stage_Aggregation,		// ۾ۺ
+	Stage_Scanline,			// ɨŻ
+	Stage_Disparity,		// Ӳ㣨ͼ
+	Stage_Refine,			// ಽӲŻ
+	Stage_Output,			// Ӳͼ
+	Stage_Count
+};
+
+/** \brief  */
+enum ADCensusBackend {
+	Backend_Inherit = -1,	// ȫֺˣڷֽ׶ã
+	Backend_Optimized = 0,	// Żʵ֣Ĭϣ
+	Backend_Reference,		// οʵ֣ԭʼر룩УŻʵ
+	Backend_Count
+};
+
 /** \brief ADCensusṹ */
 struct ADCensusOption {
 	sint32  min_disparity;		// СӲ
@@ -48,10 +69,13 @@ struct ADCensusOption {
 
 	sint32	lambda_ad;			// ADֵĲ
 	sint32	lambda_census;		// CensusֵĲ
+	CensusSize census_size;		// Censusڳߴ磬Census5x5censusֵuint32洢ڴҴۼ죬Ե
 	sint32	cross_L1;			// ʮֽ洰ڵĿռL1
 	sint32  cross_L2;			// ʮֽ洰ڵĿռL2
 	sint32	cross_t1;			// ʮֽ洰ڵɫt1
 	sint32  cross_t2;			// ʮֽ洰ڵɫt2
+	sint32	aggr_iters;			// ۾ۺϵӦʱΪ
+	float32	aggr_converge_ratio;// ۾ۺӦֵֹͣÿεӲ仯ıֵʱֹͣ0ʾ̶aggr_iters
 	float32	so_p1;				// ɨŻp1
 	float32	so_p2;				// ɨŻp2
 	sint32	so_tso;				// ɨŻtso
@@ -63,15 +87,74 @@ struct ADCensusOption {
 	bool	do_lr_check;					// Ƿһ
 	bool	do_filling;						// ǷӲ
 	bool	do_discontinuity_adjustment;	// Ƿ
+	bool	grayscale;						// ҶģʽɫתΪҶȣ׶ΣADۡۡɨŻڲ壩ȡͨҶӰɫֵcross_t1cross_t2so_tsoСҶͼʱͬС
+	bool	lazy_right_disparity;			// ǷһԼʱͼӲм䣬ֻ㱻ʵУͼӲͼ
+
+	bool	use_huge_pages;					// ڴǷʹôҳڴ
+	bool	profile_hw_counters;			// ǷͳƸ׶ӲܼLinux봫ͳƽṹ壩
+
+	ADCensusBackend backend;						// ˣ׶δעú˵ʵʱ˻زοʵ
+	ADCensusBackend stage_backends[Stage_Count];	// ֽ׶μˣBackend_Inheritʾbackend
+	bool	backend_from_env;						// ǷADCENSUS_BACKENDãadcensus_util::ParseBackends
 	
 	ADCensusOption(): min_disparity(0), max_disparity(64),
-	                  lambda_ad(10), lambda_census(30),
+	                  lambda_ad(10), lambda_census(30), census_size(Census9x7),
 	                  cross_L1(34), cross_L2(17),
 	                  cross_t1(20), cross_t2(6),
+	                  aggr_iters(4), aggr_converge_ratio(0.0f),
 	                  so_p1(1.0f), so_p2(3.0f),
 	                  so_tso(15), irv_ts(20), irv_th(0.4f),
 	                  lrcheck_thres(1.0f),
-					  do_lr_check(true), do_filling(true), do_discontinuity_adjustment(false) {} ;
+					  do_lr_check(true), do_filling(true), do_discontinuity_adjustment(false), grayscale(false), lazy_right_disparity(false),
+					  use_huge_pages(false), profile_hw_counters(false),
+					  backend(Backend_Optimized), backend_from_env(true) {
+		for (sint32 i = 0; i < Stage_Count; i++) {
+			stage_backends[i] = Backend_Inherit;
+		}
+	}
+};
+
+/** \brief ƥͳϢṹ */
+struct ADCensusStats {
+	sint64	stage_ns[Stage_Count];		// ׶κʱ룩
+	uint64	stage_bytes[Stage_Count];	// ׶Ҫķôֽڣ㷨ģʽ㣩
+	sint64	total_ns;					// ܺʱ룩
+	sint32	num_threads;				// ߳
+
+	sint32	num_outliers;				// һԼõڵ+ƥ
+	sint32	num_occlusions;				// ڵ
+	sint32	num_mismatches;				// ƥ
+	sint32	num_filled;					// ͶƱڲ
+	sint32	num_aggr_iters;				// ۾ۺϵʵʵ
+	sint32	num_right_evaluated;		// ͼӲδlazy_right_disparityʱΪ0
+
+	bool	hw_counters_valid;				// ӲܼǷã¸ֵʱΪ-1
+	sint64	stage_cycles[Stage_Count];		// ׶CPU֮߳ͣ
+	sint64	stage_instructions[Stage_Count];// ׶ָ
+	sint64	stage_llc_misses[Stage_Count];	// ׶ĩȱʧ
+	sint64	stage_dtlb_misses[Stage_Count];	// ׶TLBȱʧ
+
+	ADCensusBackend stage_backends[Stage_Count];	// ׶ʵִеļ
+
+	ADCensusStats(): stage_ns{}, stage_bytes{}, total_ns(0), num_threads(1),
+	                 num_outliers(0), num_occlusions(0), num_mismatches(0), num_filled(0), num_aggr_iters(0), num_right_evaluated(0),
+	                 hw_counters_valid(false) {
+		for (sint32 i = 0; i < Stage_Count; i++) {
+			stage_cycles[i] = stage_instructions[i] = stage_llc_misses[i] = stage_dtlb_misses[i] = -1;
+			stage_backends[i] = Backend_Reference;
+		}
+	}
+};
+
+/** \brief Уĳһ׶ĳһм仺ֺ˼Ĳ */
+struct ADCensusBufferDiff {
+	ADCensusStage stage;		// ׶
+	const char* buffer;			// 
+	sint64	num_elements;		// Ԫ
+	sint64	num_different;		// һµԪ
+	sint64	num_invalid;		// һΪЧֵһЧԪ
+	float64	max_diff;			// 죨censusΪHamming룬Ϊ۳Ϊֵľֵ
+	float64	mean_diff;			// ƽ죨num_invalid
 };
 
 /**
@@ -85,4 +168,81 @@ struct ADColor {
 	}
 };
 
+/** \brief Ӱظʽ */
+enum ADPixelFormat {
+	Pixel_BGR = 0,		// 3ͨBGROpenCVĬ˳
+	Pixel_RGB,			// 3ͨRGB
+	Pixel_BGRA,			// 4ͨBGRAA㣩
+	Pixel_Gray			// ͨҶȣɫȡҶֵcensusֱʹøֵͬĲɫӰ񾭽ضϵĻҶתȫһ£
+};
+
+/**
+* \brief ӰͼӵݣпȼظʽֱӶȡ÷ڴ棨cv::Matdatastep追ΪյBGR
+*/
+struct ADImageView {
+	const uint8* data;		// صַ
+	sint32 stride;			// пȣֽڣСڿ*ÿֽ
+	ADPixelFormat format;	// ظʽ
+	sint32 pixel_step;		// ÿֽ
+	sint32 channel[3];		// BGRڵֽƫ
+
+	ADImageView() : data(nullptr), stride(0), format(Pixel_BGR), pixel_step(3), channel{ 0, 1, 2 } {}
+	ADImageView(const uint8* _data, const sint32& _stride, const ADPixelFormat& _format) : data(_data), stride(_stride), format(_format) {
+		pixel_step = (format == Pixel_BGRA) ? 4 : ((format == Pixel_Gray) ? 1 : 3);
+		channel[0] = (format == Pixel_RGB) ? 2 : 0;
+		channel[1] = (format == Pixel_Gray) ? 0 : 1;
+		channel[2] = (format == Pixel_Gray || format == Pixel_RGB) ? 0 : 2;
+	}
+
+	/** \brief մ洢BGRӰпΪ*3 */
+	static ADImageView PackedBGR(const uint8* _data, const sint32& width) {
+		return ADImageView(_data, width * 3, Pixel_BGR);
+	}
+
+	/** \brief (x,y)ĵַ */
+	const uint8* pixel(const sint32& x, const sint32& y) const {
+		return data + static_cast<sint64>(y) * stride + x * pixel_step;
+	}
+	/** \brief صַɫ */
+	ADColor color(const uint8* p) const {
+		return ADColor(p[channel[0]], p[channel[1]], p[channel[2]]);
+	}
+	/** \brief (x,y)ɫ */
+	ADColor color(const sint32& x, const sint32& y) const {
+		return color(pixel(x, y));
+	}
+	/** \brief صַɫҶӰֻͨ */
+	sint32 max_diff(const uint8* p1, const uint8* p2) const {
+		if (format == Pixel_Gray) {
+			return abs(p1[0] - p2[0]);
+		}
+		const sint32 db = abs(p1[channel[0]] - p2[channel[0]]), dg = abs(p1[channel[1]] - p2[channel[1]]), dr = abs(p1[channel[2]] - p2[channel[2]]);
+		return std::max(db, std::max(dg, dr));
+	}
+	/** \brief صַɫķ֮ͣҶӰֻͨͬΪͨ3 */
+	sint32 sum_diff(const uint8* p1, const uint8* p2) const {
+		if (format == Pixel_Gray) {
+			return 3 * abs(p1[0] - p2[0]);
+		}
+		return abs(p1[channel[0]] - p2[channel[0]]) + abs(p1[channel[1]] - p2[channel[1]]) + abs(p1[channel[2]] - p2[channel[2]]);
+	}
+};
+
+/**
+* \brief Ӳͼͼпд÷ڴ档пȵڿ*4մ洢ʱˮֱڵ÷ڴϼͼӲ
+*		  ڲд
+*/
+struct ADDisparityView {
+	float32* data;			// صַ
+	sint32 stride;			// пȣֽڣСڿ*4
+
+	ADDisparityView() : data(nullptr), stride(0) {}
+	ADDisparityView(float32* _data, const sint32& _stride) : data(_data), stride(_stride) {}
+
+	/** \brief yеĵַ */
+	float32* row(const sint32& y) const {
+		return reinterpret_cast<float32*>(reinterpret_cast<uint8*>(data) + static_cast<sint64>(y) * stride);
+	}
+};
+
 #endif
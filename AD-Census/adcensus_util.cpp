@@ -6,15 +6,35 @@
 
 #include "adcensus_util.h"
 #include <cassert>
+#include <cstdlib>
+#include <cstring>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
 
-void adcensus_util::census_transform_9x7(const uint8* source, vector<uint64>& census, const sint32& width, const sint32& height)
+void adcensus_util::census_transform_9x7(const uint8* source, uint64* census, const sint32& width, const sint32& height)
 {
-	if (source == nullptr || census.empty() || width <= 9 || height <= 7) {
+	if (source == nullptr || census == nullptr || width <= 0 || height <= 0) {
 		return;
 	}
 
+	// census鲻Ԥȳʼ任ı߽ʽ0
+	if (width <= 9 || height <= 7) {
+		memset(census, 0, width * height * sizeof(uint64));
+		return;
+	}
+	memset(census, 0, 4 * width * sizeof(uint64));
+	memset(census + (height - 4) * width, 0, 4 * width * sizeof(uint64));
+
 	// ؼcensusֵ
+#pragma omp parallel for schedule(static)
 	for (sint32 i = 4; i < height - 4; i++) {
+		for (sint32 j = 0; j < 3; j++) {
+			census[i * width + j] = 0u;
+			census[i * width + width - 1 - j] = 0u;
+		}
 		for (sint32 j = 3; j < width - 3; j++) {
 
 			// ֵ
@@ -38,6 +58,49 @@ void adcensus_util::census_transform_9x7(const uint8* source, vector<uint64>& ce
 	}
 }
 
+void adcensus_util::census_transform_5x5(const uint8* source, uint32* census, const sint32& width, const sint32& height)
+{
+	if (source == nullptr || census == nullptr || width <= 0 || height <= 0) {
+		return;
+	}
+
+	// census鲻Ԥȳʼ任ı߽ʽ0
+	if (width <= 5 || height <= 5) {
+		memset(census, 0, width * height * sizeof(uint32));
+		return;
+	}
+	memset(census, 0, 2 * width * sizeof(uint32));
+	memset(census + (height - 2) * width, 0, 2 * width * sizeof(uint32));
+
+	// ؼcensusֵ
+#pragma omp parallel for schedule(static)
+	for (sint32 i = 2; i < height - 2; i++) {
+		for (sint32 j = 0; j < 2; j++) {
+			census[i * width + j] = 0u;
+			census[i * width + width - 1 - j] = 0u;
+		}
+		for (sint32 j = 2; j < width - 2; j++) {
+
+			// ֵ
+			const uint8 gray_center = source[i * width + j];
+
+			// СΪ5x5ĴأһȽֵֵĵĴСcensusֵ
+			uint32 census_val = 0u;
+			for (sint32 r = -2; r <= 2; r++) {
+				for (sint32 c = -2; c <= 2; c++) {
+					census_val <<= 1;
+					const uint8 gray = source[(i + r) * width + j + c];
+					if (gray < gray_center) {
+						census_val += 1;
+					}
+				}
+			}
+
+			// صcensusֵ
+			census[i * width + j] = census_val;
+		}
+	}
+}
 
 uint8 adcensus_util::Hamming64(const uint64& x, const uint64& y)
 {
@@ -52,6 +115,19 @@ uint8 adcensus_util::Hamming64(const uint64& x, const uint64& y)
 	return static_cast<uint8>(dist);
 }
 
+uint8 adcensus_util::Hamming32(const uint32& x, const uint32& y)
+{
+	uint32 dist = 0, val = x ^ y;
+
+	// Count the number of set bits
+	while (val) {
+		++dist;
+		val &= val - 1;
+	}
+
+	return static_cast<uint8>(dist);
+}
+
 void adcensus_util::MedianFilter(const float32* in, float32* out, const sint32& width, const sint32& height, const sint32 wnd_size)
 {
 	const sint32 radius = wnd_size / 2;
@@ -78,4 +154,350 @@ void adcensus_util::MedianFilter(const float32* in, float32* out, const sint32&
 			}
 		}
 	}
-}
\ No newline at end of file
+}
+
+void adcensus_util::ComputeNeighborDiffs(const ADImageView& img, const sint32& width, const sint32& height, uint8* diff_h, uint8* diff_v)
+{
+#pragma omp parallel for schedule(static)
+	for (sint32 y = 0; y < height; y++) {
+		const uint8* row = img.pixel(0, y);
+		const uint8* row_up = img.pixel(0, (y > 0) ? y - 1 : 0);
+		uint8* dh = diff_h + y * width;
+		uint8* dv = diff_v + y * width;
+		dh[0] = 0;
+		for (sint32 x = 1; x < width; x++) {
+			dh[x] = static_cast<uint8>(img.max_diff(row + x * img.pixel_step, row + (x - 1) * img.pixel_step));
+		}
+		for (sint32 x = 0; x < width; x++) {
+			dv[x] = static_cast<uint8>(img.max_diff(row + x * img.pixel_step, row_up + x * img.pixel_step));
+		}
+	}
+}
+
+float32 adcensus_util::ComputeRightDisparity(const float32* cost, const sint32& width, const sint32& min_disparity, const sint32& max_disparity,
+											 const sint32& y, const sint32& x, float32* cost_local)
+{
+	const sint32 disp_range = max_disparity - min_disparity;
+	float32 min_cost = Large_Float;
+	sint32 best_disparity = 0;
+
+	// ---ͳƺѡӲµĴֵ
+	for (sint32 d = min_disparity; d < max_disparity; d++) {
+		const sint32 d_idx = d - min_disparity;
+		const sint32 col_left = x + d;
+		if (col_left >= 0 && col_left < width) {
+			const auto& c = cost_local[d_idx] = cost[y * width * disp_range + col_left * disp_range + d_idx];
+			if (min_cost > c) {
+				min_cost = c;
+				best_disparity = d;
+			}
+		}
+		else {
+			cost_local[d_idx] = Large_Float;
+		}
+	}
+
+	// ---
+	if (best_disparity == min_disparity || best_disparity == max_disparity - 1) {
+		return static_cast<float32>(best_disparity);
+	}
+
+	// ӲǰһӲĴֵcost_1һӲĴֵcost_2
+	const float32 cost_1 = cost_local[best_disparity - 1 - min_disparity];
+	const float32 cost_2 = cost_local[best_disparity + 1 - min_disparity];
+	// һԪ߼ֵ
+	const float32 denom = cost_1 + cost_2 - 2 * min_cost;
+	if (denom != 0.0f) {
+		return static_cast<float32>(best_disparity) + (cost_1 - cost_2) / (denom * 2.0f);
+	}
+	return static_cast<float32>(best_disparity);
+}
+
+const char* adcensus_util::StageName(const ADCensusStage& stage)
+{
+	static const char* names[Stage_Count] = { "cost", "aggregation", "scanline", "disparity", "refine", "output" };
+	return (stage >= 0 && stage < Stage_Count) ? names[stage] : "unknown";
+}
+
+const char* adcensus_util::BackendName(const ADCensusBackend& backend)
+{
+	static const char* names[Backend_Count] = { "optimized", "reference" };
+	return (backend >= 0 && backend < Backend_Count) ? names[backend] : "inherit";
+}
+
+const char* adcensus_util::CensusSizeName(const CensusSize& census_size)
+{
+	switch (census_size) {
+	case Census5x5:
+		return "5x5";
+	case Census9x7:
+		return "9x7";
+	default:
+		return "unknown";
+	}
+}
+
+bool adcensus_util::ParseCensusSize(const char* name, CensusSize& census_size)
+{
+	if (name == nullptr) {
+		return false;
+	}
+	const CensusSize sizes[] = { Census5x5, Census9x7 };
+	for (auto& size : sizes) {
+		if (strcmp(name, CensusSizeName(size)) == 0) {
+			census_size = size;
+			return true;
+		}
+	}
+	return false;
+}
+
+bool adcensus_util::ParseBackends(const char* spec, ADCensusBackend backends[Stage_Count])
+{
+	if (spec == nullptr) {
+		return false;
+	}
+
+	// ƲңlenΪƳȣƲ'\0'β
+	const auto find_backend = [](const char* name, const size_t& len) -> sint32 {
+		for (sint32 i = 0; i < Backend_Count; i++) {
+			const char* backend_name = BackendName(static_cast<ADCensusBackend>(i));
+			if (strlen(backend_name) == len && strncmp(backend_name, name, len) == 0) {
+				return i;
+			}
+		}
+		return -1;
+	};
+	const auto find_stage = [](const char* name, const size_t& len) -> sint32 {
+		for (sint32 i = 0; i < Stage_Count; i++) {
+			const char* stage_name = StageName(static_cast<ADCensusStage>(i));
+			if (strlen(stage_name) == len && strncmp(stage_name, name, len) == 0) {
+				return i;
+			}
+		}
+		return -1;
+	};
+
+	// Ƚʱ飬ȫЧд
+	ADCensusBackend parsed[Stage_Count];
+	memcpy(parsed, backends, sizeof(parsed));
+	const char* p = spec;
+	while (*p != '\0') {
+		const char* end = strchr(p, ',');
+		if (end == nullptr) {
+			end = p + strlen(p);
+		}
+		const char* eq = static_cast<const char*>(memchr(p, '=', end - p));
+		if (eq == nullptr) {
+			const sint32 backend = find_backend(p, end - p);
+			if (backend < 0) {
+				return false;
+			}
+			for (sint32 i = 0; i < Stage_Count; i++) {
+				parsed[i] = static_cast<ADCensusBackend>(backend);
+			}
+		}
+		else {
+			const sint32 stage = find_stage(p, eq - p);
+			const sint32 backend = find_backend(eq + 1, end - eq - 1);
+			if (stage < 0 || backend < 0) {
+				return false;
+			}
+			parsed[stage] = static_cast<ADCensusBackend>(backend);
+		}
+		p = (*end == ',') ? end + 1 : end;
+	}
+
+	memcpy(backends, parsed, sizeof(parsed));
+	return true;
+}
+
+namespace
+{
+	/** \brief cpuidregsΪeaxebxecxedxx86ƽ̨ȫ0 */
+	void CpuId(const uint32& leaf, const uint32& subleaf, uint32 regs[4])
+	{
+		regs[0] = regs[1] = regs[2] = regs[3] = 0;
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+		int info[4];
+		__cpuidex(info, static_cast<int>(leaf), static_cast<int>(subleaf));
+		for (sint32 i = 0; i < 4; i++) {
+			regs[i] = static_cast<uint32>(info[i]);
+		}
+#elif defined(__x86_64__) || defined(__i386__)
+		__cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#else
+		(void)leaf; (void)subleaf;
+#endif
+	}
+
+	/** \brief ȡչƼĴXCR0ȷϲϵͳAVX/AVX-512Ĵ״̬ */
+	uint64 XGetBv()
+	{
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+		return _xgetbv(0);
+#elif defined(__x86_64__) || defined(__i386__)
+		uint32 eax = 0, edx = 0;
+		__asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+		return (static_cast<uint64>(edx) << 32) | eax;
+#else
+		return 0;
+#endif
+	}
+
+	adcensus_util::CpuFeatures DetectFeatures()
+	{
+		adcensus_util::CpuFeatures features;
+		memset(&features, 0, sizeof(features));
+
+		uint32 regs[4];
+		CpuId(0, 0, regs);
+		const uint32 max_leaf = regs[0];
+		if (max_leaf < 1) {
+			return features;
+		}
+
+		CpuId(1, 0, regs);
+		features.sse42 = (regs[2] & (1u << 20)) != 0;
+		features.popcnt = (regs[2] & (1u << 23)) != 0;
+		const bool osxsave = (regs[2] & (1u << 27)) != 0;
+		const uint64 xcr0 = osxsave ? XGetBv() : 0;
+		// XMMYMM״̬bit12AVX-512opmaskZMM״̬bit567
+		const bool os_avx = (xcr0 & 0x6) == 0x6;
+		const bool os_avx512 = os_avx && (xcr0 & 0xe0) == 0xe0;
+		features.avx = os_avx && (regs[2] & (1u << 28)) != 0;
+		features.fma = features.avx && (regs[2] & (1u << 12)) != 0;
+
+		if (max_leaf >= 7) {
+			CpuId(7, 0, regs);
+			features.avx2 = features.avx && (regs[1] & (1u << 5)) != 0;
+			features.avx512f = os_avx512 && (regs[1] & (1u << 16)) != 0;
+			features.avx512bw = os_avx512 && (regs[1] & (1u << 30)) != 0;
+			features.avx512vl = os_avx512 && (regs[1] & (1u << 31)) != 0;
+			features.avx512vnni = os_avx512 && (regs[2] & (1u << 11)) != 0;
+		}
+		return features;
+	}
+
+	/** \brief бػں˵ӲΧkernels[0]Ϊͨúkernels[i+1]Ӧspecialized_ranges[i] */
+	const sint32 specialized_ranges[] = { 64, 128, 256 };
+	const sint32 num_tables = sizeof(specialized_ranges) / sizeof(specialized_ranges[0]) + 1;
+
+	/** \brief ״̬״ʹʱCPUԲ󶨺 */
+	struct DispatchState {
+		adcensus_util::CpuFeatures features;
+		adcensus_util::CpuIsa detected;
+		adcensus_util::CpuIsa active;
+		adcensus_util::KernelTable kernels[num_tables];
+	};
+
+	void Bind(const adcensus_util::CpuIsa& isa, adcensus_util::KernelTable* tables)
+	{
+		for (sint32 i = 0; i < num_tables; i++) {
+			const sint32 disp_range = (i == 0) ? 0 : specialized_ranges[i - 1];
+			switch (isa) {
+			case adcensus_util::Isa_AVX512:
+				adcensus_util::BindKernelsAVX512(tables[i], disp_range);
+				break;
+			case adcensus_util::Isa_AVX2:
+				adcensus_util::BindKernelsAVX2(tables[i], disp_range);
+				break;
+			case adcensus_util::Isa_SSE42:
+				adcensus_util::BindKernelsSSE42(tables[i], disp_range);
+				break;
+			default:
+				adcensus_util::BindKernelsScalar(tables[i], disp_range);
+				break;
+			}
+		}
+	}
+
+	DispatchState& State()
+	{
+		static DispatchState state = [] {
+			DispatchState init;
+			init.features = DetectFeatures();
+			const auto& f = init.features;
+			if (f.avx512f && f.avx512bw && f.avx512vl && f.avx2 && f.popcnt) {
+				init.detected = adcensus_util::Isa_AVX512;
+			}
+			else if (f.avx2 && f.popcnt) {
+				init.detected = adcensus_util::Isa_AVX2;
+			}
+			else if (f.sse42 && f.popcnt) {
+				init.detected = adcensus_util::Isa_SSE42;
+			}
+			else {
+				init.detected = adcensus_util::Isa_Scalar;
+			}
+			init.active = init.detected;
+
+			// ָļڱ֧ʱЧ
+			adcensus_util::CpuIsa isa;
+			const char* name = getenv("ADCENSUS_ISA");
+			if (name != nullptr && adcensus_util::ParseIsa(name, isa) && isa <= init.detected) {
+				init.active = isa;
+			}
+			Bind(init.active, init.kernels);
+			return init;
+		}();
+		return state;
+	}
+}
+
+const adcensus_util::CpuFeatures& adcensus_util::GetCpuFeatures()
+{
+	return State().features;
+}
+
+adcensus_util::CpuIsa adcensus_util::DetectIsa()
+{
+	return State().detected;
+}
+
+adcensus_util::CpuIsa adcensus_util::GetIsa()
+{
+	return State().active;
+}
+
+bool adcensus_util::SetIsa(const CpuIsa& isa)
+{
+	auto& state = State();
+	if (isa < Isa_Scalar || isa > state.detected) {
+		return false;
+	}
+	state.active = isa;
+	Bind(isa, state.kernels);
+	return true;
+}
+
+const char* adcensus_util::IsaName(const CpuIsa& isa)
+{
+	static const char* names[Isa_Count] = { "scalar", "sse42", "avx2", "avx512" };
+	return (isa >= 0 && isa < Isa_Count) ? names[isa] : "unknown";
+}
+
+bool adcensus_util::ParseIsa(const char* name, CpuIsa& isa)
+{
+	if (name == nullptr) {
+		return false;
+	}
+	for (sint32 i = 0; i < Isa_Count; i++) {
+		if (strcmp(name, IsaName(static_cast<CpuIsa>(i))) == 0) {
+			isa = static_cast<CpuIsa>(i);
+			return true;
+		}
+	}
+	return false;
+}
+
+const adcensus_util::KernelTable& adcensus_util::GetKernels(const sint32& disp_range)
+{
+	const auto& state = State();
+	for (sint32 i = 1; i < num_tables; i++) {
+		if (disp_range == specialized_ranges[i - 1]) {
+			return state.kernels[i];
+		}
+	}
+	return state.kernels[0];
+}
@@ -6,6 +6,7 @@
 
 #pragma once
 #include <algorithm>
+#include <cmath>
 #include "adcensus_types.h"
 
 
@@ -18,9 +19,18 @@ namespace adcensus_util
 	* \param width	룬Ӱ
 	* \param height	룬Ӱ
 	*/
-	void census_transform_9x7(const uint8* source, vector<uint64>& census, const sint32& width, const sint32& height);
+	void census_transform_9x7(const uint8* source, uint64* census, const sint32& width, const sint32& height);
+	/**
+	* \brief 5x5ڵcensus任censusֵΪ25λuint32洢
+	* \param source	룬Ӱ
+	* \param census	censusֵ飬Ԥռ
+	* \param width	룬Ӱ
+	* \param height	룬Ӱ
+	*/
+	void census_transform_5x5(const uint8* source, uint32* census, const sint32& width, const sint32& height);
 	// Hamming
 	uint8 Hamming64(const uint64& x, const uint64& y);
+	uint8 Hamming32(const uint32& x, const uint32& y);
 
 	/**
 	* \brief ֵ˲
@@ -31,4 +41,187 @@ namespace adcensus_util
 	* \param wnd_size		룬ڿ
 	*/
 	void MedianFilter(const float32* in, float32* out, const sint32& width, const sint32& height, const sint32 wnd_size);
+
+	/**
+	* \brief صɫͼľֵֵ۹ɨŻ
+	* \param img		룬Ӱͼ
+	* \param width		룬Ӱ
+	* \param height	룬Ӱ
+	* \param diff_h	صɫ룬Ϊ0
+	* \param diff_v	Ϸصɫ룬Ϊ0
+	*/
+	void ComputeNeighborDiffs(const ADImageView& img, const sint32& width, const sint32& height, uint8* diff_h, uint8* diff_v);
+
+	/**
+	* \brief ͼصӲcost(xr,y,d) = cost(xr+d,y,d)ȡС۵Ӳ
+	* \param cost				룬ͼۺϴ
+	* \param width			룬
+	* \param min_disparity	룬СӲ
+	* \param max_disparity	룬Ӳ
+	* \param y				룬к
+	* \param x				룬ͼк
+	* \param cost_local		룬ΪӲΧʱ
+	* \return ӲֵӲλӲΧʱ
+	*/
+	float32 ComputeRightDisparity(const float32* cost, const sint32& width, const sint32& min_disparity, const sint32& max_disparity,
+								  const sint32& y, const sint32& x, float32* cost_local);
+
+	/** \brief ׶ƣcostaggregationscanlinedisparityrefineoutput */
+	const char* StageName(const ADCensusStage& stage);
+
+	/** \brief ƣoptimizedreference */
+	const char* BackendName(const ADCensusBackend& backend);
+
+	/** \brief censusڳߴƣ5x59x7 */
+	const char* CensusSizeName(const CensusSize& census_size);
+
+	/**
+	* \brief ƽcensusڳߴ
+	* \param name			룬ƣ5x59x7
+	* \param census_size	censusڳߴ
+	* \return true: ɹ
+	*/
+	bool ParseCensusSize(const char* name, CensusSize& census_size);
+
+	/**
+	* \brief ôʽΪŷָÿΪн׶Σ򡰽׶=õ׶Σ
+	*		  ֵȳֵ硰optimized,aggregation=reference
+	* \param spec			룬ô
+	* \param backends		׶μˣֻ޸ô漰Ľ׶
+	* \return true: ɹôδ֪Ľ׶ʱfalseҲ޸backends
+	*/
+	bool ParseBackends(const char* spec, ADCensusBackend backends[Stage_Count]);
+
+	// ʱָ //
+
+	/** \brief οʵexp(float)Ľͣƽ̨ؿΪfloatdouble۲ұ֮һԱ֤λͬ */
+	typedef decltype(exp(-1.0f / 1)) ExpValue;
+
+	/** \brief ָ𣬸߼ͼ */
+	enum CpuIsa {
+		Isa_Scalar = 0,		// ͨʵ
+		Isa_SSE42,			// SSE4.2popcnt
+		Isa_AVX2,			// AVX2
+		Isa_AVX512,			// AVX-512F/BW/VL
+		Isa_Count
+	};
+
+	/** \brief CPUԣcpuid⣬ȷϲϵͳ֧ӦĴ״̬ */
+	struct CpuFeatures {
+		bool sse42;
+		bool popcnt;
+		bool avx;
+		bool avx2;
+		bool fma;
+		bool avx512f;
+		bool avx512bw;
+		bool avx512vl;
+		bool avx512vnni;
+	};
+
+	/**
+	* \brief ں˺ָһݣӦĲοʵͬ
+	* ں˵Ľοʵλһ£ֻӡȽϡ㣬ʹFMA
+	* ӲΧصںˣcost_rowcost_row_5x5accumulatedividescanline_stepػӲΧdisp_range
+	*/
+	struct KernelTable {
+		/** \brief ػӲΧ0ΪͨãӲΧ */
+		sint32 disp_range;
+		/** \brief 9x7 census任ͬcensus_transform_9x7 */
+		void (*census_9x7)(const uint8* source, uint64* census, const sint32& width, const sint32& height);
+		/** \brief 5x5 census任ͬcensus_transform_5x5 */
+		void (*census_5x5)(const uint8* source, uint32* census, const sint32& width, const sint32& height);
+		/** \brief Hamming룬ͬHamming64 */
+		uint8 (*hamming64)(const uint64& x, const uint64& y);
+		/** \brief Hamming룬ͬHamming32 */
+		uint8 (*hamming32)(const uint32& x, const uint32& y);
+		/**
+		* \brief һصĳʼ
+		* \param img_left/img_right			ӰͼΪҶʱÿֻͨ
+		* \param y								к
+		* \param census_row_l/census_row_r		census
+		* \param exp_ad/exp_census				AD0~765census0~64ָұ
+		* \param cost_row						дۣwidth*disp_range
+		*/
+		void (*cost_row)(const ADImageView& img_left, const ADImageView& img_right, const sint32& y,
+						 const uint64* census_row_l, const uint64* census_row_r,
+						 const sint32& width, const sint32& min_disparity, const sint32& max_disparity,
+						 const ExpValue* exp_ad, const ExpValue* exp_census, float32* cost_row);
+		/** \brief һصĳʼۣ5x5 censusͬcost_row */
+		void (*cost_row_5x5)(const ADImageView& img_left, const ADImageView& img_right, const sint32& y,
+							 const uint32* census_row_l, const uint32* census_row_r,
+							 const sint32& width, const sint32& min_disparity, const sint32& max_disparity,
+							 const ExpValue* exp_ad, const ExpValue* exp_census, float32* cost_row);
+		/** \brief ۼӣdst[i] += src[i] */
+		void (*accumulate)(float32* dst, const float32* src, const sint32& n);
+		/** \brief ֧dst[i] = dst[i] / count */
+		void (*divide)(float32* dst, const float32& count, const sint32& n);
+		/**
+		* \brief ɨŻĵһصӲ
+		* \param cost		ǰصĴ
+		* \param last		·ϸصľۺϴ
+		* \param min_last	·ϸصСۺϴ
+		* \param edge_r		ӲӰͬǷΪɫԵɫСtso01
+		* \param p1/p2		edge_rȡõĳͷ[0]ΪǱԵ[1]ΪԵ
+		* \param out		ǰصľۺϴ
+		* \return ǰصСۺϴ
+		*/
+		float32 (*scanline_step)(const float32* cost, const float32* last, const float32& min_last, const uint8* edge_r,
+								 const float32* p1, const float32* p2, float32* out, const sint32& disp_range);
+		/** \brief ֵ˲ͬMedianFilterinoutͬʱ3x35x5е㣻inoutͬʱ͵˲ */
+		void (*median)(const float32* in, float32* out, const sint32& width, const sint32& height, const sint32 wnd_size);
+		/**
+		* \brief ӲͼеsobelԵ⣬ͬMultiStepRefiner::EdgeDetect
+		* \param row0/row1/row2	һСǰСһӲ
+		* \param width			
+		* \param threshold		ݶֵ
+		* \param edge			ǰиǷΪԵ01βΪ0
+		*/
+		void (*sobel_edge)(const float32* row0, const float32* row1, const float32* row2, const sint32& width,
+						   const float32& threshold, uint8* edge);
+	};
+
+	/** \brief ȡCPUԣ״εʱ */
+	const CpuFeatures& GetCpuFeatures();
+
+	/** \brief ֵָ֧ */
+	CpuIsa DetectIsa();
+
+	/** \brief ǰʹõָ */
+	CpuIsa GetIsa();
+
+	/**
+	* \brief ǿʹĳһָڲԼԱȣƥ俪ʼǰã̰߳ȫ
+	* ״ʹʱĬΪDetectIsa()ɻADCENSUS_ISAscalarsse42avx2avx512ָ
+	* \param isa		룬ָ
+	* \return true: óɹfalse: ָ֧ü𣬱ԭ
+	*/
+	bool SetIsa(const CpuIsa& isa);
+
+	/** \brief ָ */
+	const char* IsaName(const CpuIsa& isa);
+
+	/**
+	* \brief ƽָ
+	* \param name		룬ƣscalarsse42avx2avx512
+	* \param isa		ָ
+	* \return true: ɹ
+	*/
+	bool ParseIsa(const char* name, CpuIsa& isa);
+
+	/**
+	* \brief ǰָļں˺
+	* \param disp_range	룬ӲΧΪ64128256ʱرػ˸ӲΧĺ򷵻ͨú
+	*/
+	const KernelTable& GetKernels(const sint32& disp_range = 0);
+
+	/**
+	* \brief ָĺ󶨣adcensus_kernels_*.cpp
+	* \param table			
+	* \param disp_range	룬ػӲΧ޸ػʱͨʵ
+	*/
+	void BindKernelsScalar(KernelTable& table, const sint32& disp_range);
+	void BindKernelsSSE42(KernelTable& table, const sint32& disp_range);
+	void BindKernelsAVX2(KernelTable& table, const sint32& disp_range);
+	void BindKernelsAVX512(KernelTable& table, const sint32& disp_range);
 }
\ No newline at end of file
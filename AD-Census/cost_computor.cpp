@@ -6,10 +6,21 @@
 
 #include "cost_computor.h"
 #include "adcensus_util.h"
+#include "adcensus_trace.h"
+#include <cmath>
+#include <cstring>
 
-CostComputor::CostComputor(): width_(0), height_(0), img_left_(nullptr), img_right_(nullptr),
-                              lambda_ad_(0), lambda_census_(0), min_disparity_(0), max_disparity_(0),
-                              is_initialized_(false) { }
+using adcensus_util::ExpValue;
+
+CostComputor::CostComputor(): width_(0), height_(0),
+                              gray_left_(nullptr), gray_right_(nullptr), census_left_(nullptr), census_right_(nullptr),
+                              cost_init_(nullptr),
+                              lambda_ad_(0), lambda_census_(0), census_size_(Census9x7), grayscale_(false), min_disparity_(0), max_disparity_(0),
+                              backend_(Backend_Optimized), is_initialized_(false)
+{
+	cost_kernels_.Register(Backend_Optimized, &CostComputor::ComputeCostOptimized);
+	cost_kernels_.Register(Backend_Reference, &CostComputor::ComputeCostReference);
+}
 
 CostComputor::~CostComputor()
 {
@@ -30,43 +41,63 @@ bool CostComputor::Initialize(const sint32& width, const sint32& height, const s
 		return false;
 	}
 
-	// ҶݣӰ
-	gray_left_.resize(img_size);
-	gray_right_.resize(img_size);
-	// censusݣӰ
-	census_left_.resize(img_size,0);
-	census_right_.resize(img_size,0);
-	// ʼ
-	cost_init_.resize(img_size * disp_range);
-
-	is_initialized_ = !gray_left_.empty() && !gray_right_.empty() && !census_left_.empty() && !census_right_.empty() && !cost_init_.empty();
+	// ҶȡcensusʼSetBuffers
+	is_initialized_ = true;
 	return is_initialized_;
 }
 
-void CostComputor::SetData(const uint8* img_left, const uint8* img_right)
+void CostComputor::SetBuffers(uint8* gray_left, uint8* gray_right, void* census_left, void* census_right, float32* cost_init)
+{
+	gray_left_ = gray_left;
+	gray_right_ = gray_right;
+	census_left_ = census_left;
+	census_right_ = census_right;
+	cost_init_ = cost_init;
+}
+
+void CostComputor::SetData(const ADImageView& img_left, const ADImageView& img_right)
 {
 	img_left_ = img_left;
 	img_right_ = img_right;
 }
 
-void CostComputor::SetParams(const sint32& lambda_ad, const sint32& lambda_census)
+void CostComputor::SetParams(const sint32& lambda_ad, const sint32& lambda_census, const CensusSize& census_size, const bool& grayscale)
 {
 	lambda_ad_ = lambda_ad;
 	lambda_census_ = lambda_census;
+	census_size_ = census_size;
+	grayscale_ = grayscale;
+}
+
+bool CostComputor::SetBackend(const ADCensusBackend& backend)
+{
+	backend_ = backend;
+	return cost_kernels_.Has(backend);
 }
 
 void CostComputor::ComputeGray()
 {
+	ADCENSUS_TRACE_SCOPE("ComputeGray");
 	// ɫתҶ
 	for (sint32 n = 0; n < 2; n++) {
-		const auto color = (n == 0) ? img_left_ : img_right_;
+		const auto& view = (n == 0) ? img_left_ : img_right_;
 		auto& gray = (n == 0) ? gray_left_ : gray_right_;
+		if (view.format == Pixel_Gray) {
+			// ҶӰֱӰпעתضȡͬĲɫӰ(v,v,v)תΪv-1ֵͬĻҶͼͬ
+			for (sint32 y = 0; y < height_; y++) {
+				memcpy(gray + y * width_, view.pixel(0, y), width_ * sizeof(uint8));
+			}
+			continue;
+		}
+#pragma omp parallel for schedule(static)
 		for (sint32 y = 0; y < height_; y++) {
+			const uint8* color = view.pixel(0, y);
 			for (sint32 x = 0; x < width_; x++) {
-				const auto b = color[y * width_ * 3 + 3 * x];
-				const auto g = color[y * width_ * 3 + 3 * x + 1];
-				const auto r = color[y * width_ * 3 + 3 * x + 2];
+				const auto b = color[view.channel[0]];
+				const auto g = color[view.channel[1]];
+				const auto r = color[view.channel[2]];
 				gray[y * width_ + x] = uint8(r * 0.299 + g * 0.587 + b * 0.114);
+				color += view.pixel_step;
 			}
 		}
 	}
@@ -74,13 +105,80 @@ void CostComputor::ComputeGray()
 
 void CostComputor::CensusTransform()
 {
-	// Ӱcensus任
-	adcensus_util::census_transform_9x7(&gray_left_[0], census_left_, width_, height_);
-	adcensus_util::census_transform_9x7(&gray_right_[0], census_right_, width_, height_);
+	ADCENSUS_TRACE_SCOPE("CensusTransform");
+	// Ӱcensus任Żʵʹõǰָں
+	const bool is_reference = (backend_ == Backend_Reference);
+	if (census_size_ == Census5x5) {
+		const auto census_transform = is_reference ? adcensus_util::census_transform_5x5 : adcensus_util::GetKernels().census_5x5;
+		census_transform(gray_left_, static_cast<uint32*>(census_left_), width_, height_);
+		census_transform(gray_right_, static_cast<uint32*>(census_right_), width_, height_);
+	}
+	else {
+		const auto census_transform = is_reference ? adcensus_util::census_transform_9x7 : adcensus_util::GetKernels().census_9x7;
+		census_transform(gray_left_, static_cast<uint64*>(census_left_), width_, height_);
+		census_transform(gray_right_, static_cast<uint64*>(census_right_), width_, height_);
+	}
 }
 
 void CostComputor::ComputeCost()
 {
+	(this->*cost_kernels_.Get(backend_))();
+}
+
+void CostComputor::ComputeCostOptimized()
+{
+	ADCENSUS_TRACE_SCOPE("ComputeCost");
+	const sint32 disp_range = max_disparity_ - min_disparity_;
+
+	// ָұADͨľֵ֮ͣ0~765censusHamming루0~64
+	// οʵֵıʽȫֵͬλһ
+	ExpValue exp_ad[766], exp_census[65];
+	for (sint32 sad = 0; sad < 766; sad++) {
+		exp_ad[sad] = exp(-(sad / 3.0f) / lambda_ad_);
+	}
+	for (sint32 ham = 0; ham < 65; ham++) {
+		exp_census[ham] = exp(-static_cast<float32>(ham) / lambda_census_);
+	}
+
+	// ۣеõǰָںˣӲΧcensusڳߴбػ
+	const auto& kernels = adcensus_util::GetKernels(disp_range);
+	const bool census_5x5 = (census_size_ == Census5x5);
+#pragma omp parallel
+	{
+		ADCENSUS_TRACE_SCOPE("ComputeCost:worker");
+#pragma omp for schedule(static) nowait
+		for (sint32 y = 0; y < height_; y++) {
+			float32* cost_row = cost_init_ + static_cast<size_t>(y) * width_ * disp_range;
+			if (census_5x5) {
+				kernels.cost_row_5x5(img_left_, img_right_, y, static_cast<const uint32*>(census_left_) + y * width_,
+									 static_cast<const uint32*>(census_right_) + y * width_,
+									 width_, min_disparity_, max_disparity_, exp_ad, exp_census, cost_row);
+			}
+			else {
+				kernels.cost_row(img_left_, img_right_, y, static_cast<const uint64*>(census_left_) + y * width_,
+								 static_cast<const uint64*>(census_right_) + y * width_,
+								 width_, min_disparity_, max_disparity_, exp_ad, exp_census, cost_row);
+			}
+		}
+	}
+}
+
+void CostComputor::ComputeCostReference()
+{
+	if (census_size_ == Census5x5) {
+		ComputeCostReference(static_cast<const uint32*>(census_left_), static_cast<const uint32*>(census_right_),
+							 adcensus_util::Hamming32);
+	}
+	else {
+		ComputeCostReference(static_cast<const uint64*>(census_left_), static_cast<const uint64*>(census_right_),
+							 adcensus_util::Hamming64);
+	}
+}
+
+template <typename CensusT>
+void CostComputor::ComputeCostReference(const CensusT* census_left, const CensusT* census_right, uint8 (*hamming)(const CensusT&, const CensusT&))
+{
+	ADCENSUS_TRACE_SCOPE("ComputeCost");
 	const sint32 disp_range = max_disparity_ - min_disparity_;
 
 	// Ԥ
@@ -88,33 +186,42 @@ void CostComputor::ComputeCost()
 	const auto lambda_census = lambda_census_;
 
 	// 
-	for (sint32 y = 0; y < height_; y++) {
-		for (sint32 x = 0; x < width_; x++) {
-			const auto bl = img_left_[y * width_ * 3 + 3 * x];
-			const auto gl = img_left_[y * width_ * 3 + 3 * x + 1];
-			const auto rl = img_left_[y * width_ * 3 + 3 * x + 2];
-			const auto& census_val_l = census_left_[y * width_ + x];
-			// Ӳֵ
-			for (sint32 d = min_disparity_; d < max_disparity_; d++) {
-				auto& cost = cost_init_[y * width_ * disp_range + x * disp_range + (d - min_disparity_)];
-				const sint32 xr = x - d;
-				if (xr < 0 || xr >= width_) {
-					cost = 1.0f;
-					continue;
-				}
+	// оָ̬̣߳ʼ۵ڴҳɺе߳״д
+#pragma omp parallel
+	{
+		// ¼̵߳ĹƬΣڹ۲츺Ƿ
+		ADCENSUS_TRACE_SCOPE("ComputeCost:worker");
+#pragma omp for schedule(static) nowait
+		for (sint32 y = 0; y < height_; y++) {
+			for (sint32 x = 0; x < width_; x++) {
+				const auto color_l = img_left_.color(x, y);
+				const auto bl = color_l.b;
+				const auto gl = color_l.g;
+				const auto rl = color_l.r;
+				const auto& census_val_l = census_left[y * width_ + x];
+				// Ӳֵ
+				for (sint32 d = min_disparity_; d < max_disparity_; d++) {
+					auto& cost = cost_init_[y * width_ * disp_range + x * disp_range + (d - min_disparity_)];
+					const sint32 xr = x - d;
+					if (xr < 0 || xr >= width_) {
+						cost = 1.0f;
+						continue;
+					}
 
-				// ad
-				const auto br = img_right_[y * width_ * 3 + 3 * xr];
-				const auto gr = img_right_[y * width_ * 3 + 3 * xr + 1];
-				const auto rr = img_right_[y * width_ * 3 + 3 * xr + 2];
-				const float32 cost_ad = (abs(bl - br) + abs(gl - gr) + abs(rl - rr)) / 3.0f;
+					// ad
+					const auto color_r = img_right_.color(xr, y);
+					const auto br = color_r.b;
+					const auto gr = color_r.g;
+					const auto rr = color_r.r;
+					const float32 cost_ad = (abs(bl - br) + abs(gl - gr) + abs(rl - rr)) / 3.0f;
 
-				// census
-				const auto& census_val_r = census_right_[y * width_ + xr];
-				const float32 cost_census = static_cast<float32>(adcensus_util::Hamming64(census_val_l, census_val_r));
+					// census
+					const auto& census_val_r = census_right[y * width_ + xr];
+					const float32 cost_census = static_cast<float32>(hamming(census_val_l, census_val_r));
 
-				// ad-census
-				cost = 1 - exp(-cost_ad / lambda_ad) + 1 - exp(-cost_census / lambda_census);
+					// ad-census
+					cost = 1 - exp(-cost_ad / lambda_ad) + 1 - exp(-cost_census / lambda_census);
+				}
 			}
 		}
 	}
@@ -122,13 +229,20 @@ void CostComputor::ComputeCost()
 
 void CostComputor::Compute()
 {
-	if(!is_initialized_) {
+	if(!is_initialized_ || gray_left_ == nullptr || gray_right_ == nullptr ||
+		census_left_ == nullptr || census_right_ == nullptr || cost_init_ == nullptr) {
 		return;
 	}
 
 	// Ҷͼ
 	ComputeGray();
 
+	// ҶģʽAD۸Ϊȡմ洢ĻҶӰ
+	if (grayscale_) {
+		img_left_ = ADImageView(gray_left_, width_, Pixel_Gray);
+		img_right_ = ADImageView(gray_right_, width_, Pixel_Gray);
+	}
+
 	// census任
 	CensusTransform();
 
@@ -138,10 +252,30 @@ void CostComputor::Compute()
 
 float32* CostComputor::get_cost_ptr()
 {
-	if (!cost_init_.empty()) {
-		return &cost_init_[0];
-	}
-	else {
-		return nullptr;
-	}
+	return cost_init_;
+}
+
+const void* CostComputor::get_census_left_ptr() const
+{
+	return census_left_;
+}
+
+const void* CostComputor::get_census_right_ptr() const
+{
+	return census_right_;
+}
+
+CensusSize CostComputor::get_census_size() const
+{
+	return census_size_;
+}
+
+const uint8* CostComputor::get_gray_left_ptr() const
+{
+	return gray_left_;
+}
+
+const uint8* CostComputor::get_gray_right_ptr() const
+{
+	return gray_right_;
 }
@@ -8,6 +8,7 @@
 #define AD_CENSUS_COST_COMPUTOR_H_
 
 #include "adcensus_types.h"
+#include "stage_kernels.h"
 
 /**
  * \brief ۼ
@@ -27,19 +28,49 @@ public:
 	 */
 	bool Initialize(const sint32& width, const sint32& height, const sint32& min_disparity, const sint32& max_disparity);
 
+	/**
+	 * \brief ôۼĻ棬ڴⲿڴͳһ
+	 * \param gray_left		// ӰҶݣwidth*height
+	 * \param gray_right		// ӰҶݣwidth*height
+	 * \param census_left		// Ӱcensusݣwidth*heightԪcensusڳߴ5x5Ϊuint329x7Ϊuint64
+	 * \param census_right	// Ӱcensusݣwidth*heightԪͬ
+	 * \param cost_init		// ʼݣwidth*height*disp_range
+	 */
+	void SetBuffers(uint8* gray_left, uint8* gray_right, void* census_left, void* census_right, float32* cost_init);
+
 	/**
 	 * \brief ôۼ
-	 * \param img_left		// Ӱݣͨ
-	 * \param img_right		// Ӱݣͨ
+	 * \param img_left		// Ӱͼ
+	 * \param img_right		// Ӱͼ
 	 */
-	void SetData(const uint8* img_left, const uint8* img_right);
+	void SetData(const ADImageView& img_left, const ADImageView& img_right);
 
 	/**
 	 * \brief ôۼĲ
 	 * \param lambda_ad		// lambda_ad
 	 * \param lambda_census // lambda_census
+	 * \param census_size	// censusڳߴ
+	 * \param grayscale		// ҶģʽADԻҶӰ
+	 */
+	void SetParams(const sint32& lambda_ad, const sint32& lambda_census, const CensusSize& census_size, const bool& grayscale);
+
+	/**
+	 * \brief ü
+	 * \param backend		// ˣοʵΪԭʼر
+	 * \return true: úעʵ֣false: δעᣬ˻زοʵ
 	 */
-	void SetParams(const sint32& lambda_ad, const sint32& lambda_census);
+	bool SetBackend(const ADCensusBackend& backend);
+
+	/** \brief ȡӰcensusָ룬Ԫͼget_census_size */
+	const void* get_census_left_ptr() const;
+	/** \brief ȡӰcensusָ룬Ԫͼget_census_size */
+	const void* get_census_right_ptr() const;
+	/** \brief ȡcensusڳߴ */
+	CensusSize get_census_size() const;
+	/** \brief ȡӰҶָ */
+	const uint8* get_gray_left_ptr() const;
+	/** \brief ȡӰҶָ */
+	const uint8* get_gray_right_ptr() const;
 
 	/** \brief ʼ */
 	void Compute();
@@ -54,40 +85,57 @@ private:
 	/** \brief Census任 */
 	void CensusTransform();
 
-	/** \brief  */
+	/** \brief ۣ˵עʵ */
 	void ComputeCost();
+
+	/** \brief ۣŻʵ֣ */
+	void ComputeCostOptimized();
+	/** \brief ۣοʵ֣ */
+	void ComputeCostReference();
+	/** \brief ۣοʵ֣censusֵΪCensusT */
+	template <typename CensusT>
+	void ComputeCostReference(const CensusT* census_left, const CensusT* census_right, uint8 (*hamming)(const CensusT&, const CensusT&));
 private:
 	/** \brief ͼߴ */
 	sint32	width_;
 	sint32	height_;
 
 	/** \brief Ӱ */
-	const uint8* img_left_;
-	const uint8* img_right_;
+	ADImageView img_left_;
+	ADImageView img_right_;
 
 	/** \brief ӰҶ	 */
-	vector<uint8> gray_left_;
+	uint8* gray_left_;
 	/** \brief ӰҶ	 */
-	vector<uint8> gray_right_;
+	uint8* gray_right_;
 
 	/** \brief Ӱcensus	*/
-	vector<uint64> census_left_;
+	void* census_left_;
 	/** \brief Ӱcensus	*/
-	vector<uint64> census_right_;
+	void* census_right_;
 
 	/** \brief ʼƥ	*/
-	vector<float32> cost_init_;
+	float32* cost_init_;
 
 	/** \brief lambda_ad*/
 	sint32 lambda_ad_;
 	/** \brief lambda_census*/
 	sint32 lambda_census_;
+	/** \brief censusڳߴ */
+	CensusSize census_size_;
+	/** \brief Ҷģʽ */
+	bool grayscale_;
 
 	/** \brief СӲֵ */
 	sint32 min_disparity_;
 	/** \brief Ӳֵ */
 	sint32 max_disparity_;
 
+	/** \brief  */
+	ADCensusBackend backend_;
+	/** \brief ۼĸʵ */
+	StageKernels<void (CostComputor::*)()> cost_kernels_;
+
 	/** \brief Ƿɹʼ־	*/
 	bool is_initialized_;
 };
@@ -5,11 +5,25 @@
 */
 
 #include "cross_aggregator.h"
+#include "adcensus_trace.h"
+#include "adcensus_util.h"
 
-CrossAggregator::CrossAggregator(): width_(0), height_(0), img_left_(nullptr), img_right_(nullptr),
-                                    cost_init_(nullptr),
+namespace
+{
+	/** \brief ӦʱصСм */
+	const sint32 Sample_Step = 4;
+}
+
+CrossAggregator::CrossAggregator(): width_(0), height_(0), cross_arms_(nullptr), diff_h_(nullptr), diff_v_(nullptr),
+                                    cost_init_(nullptr), cost_aggr_(nullptr),
+                                    cost_vol_tmp_(nullptr), cost_tmp_{ nullptr, nullptr },
+                                    sup_count_{ nullptr, nullptr }, sup_count_tmp_(nullptr),
                                     cross_L1_(0), cross_L2_(0), cross_t1_(0), cross_t2_(0),
-                                    min_disparity_(0), max_disparity_(0), is_initialized_(false) { }
+                                    min_disparity_(0), max_disparity_(0), num_iters_(0), backend_(Backend_Optimized), is_initialized_(false)
+{
+	aggregate_kernels_.Register(Backend_Optimized, &CrossAggregator::AggregateAllDisparities);
+	aggregate_kernels_.Register(Backend_Reference, &CrossAggregator::AggregateByDisparity);
+}
 
 CrossAggregator::~CrossAggregator()
 {
@@ -30,40 +44,36 @@ bool CrossAggregator::Initialize(const sint32& width, const sint32& height, cons
 		return is_initialized_;
 	}
 
-	// Ϊʮֱڴ
-	vec_cross_arms_.clear();
-	vec_cross_arms_.resize(img_size);
-
-	// Ϊʱڴ
-	vec_cost_tmp_[0].clear();
-	vec_cost_tmp_[0].resize(img_size);
-	vec_cost_tmp_[1].clear();
-	vec_cost_tmp_[1].resize(img_size);
-
-	// Ϊ洢ÿ֧ڴ
-	vec_sup_count_[0].clear();
-	vec_sup_count_[0].resize(img_size);
-	vec_sup_count_[1].clear();
-	vec_sup_count_[1].resize(img_size);
-	vec_sup_count_tmp_.clear();
-	vec_sup_count_tmp_.resize(img_size);
-
-	// Ϊۺϴڴ
-	cost_aggr_.resize(img_size * disp_range);
-
-	is_initialized_ = !vec_cross_arms_.empty() && !vec_cost_tmp_[0].empty() && !vec_cost_tmp_[1].empty() 
-					&& !vec_sup_count_[0].empty() && !vec_sup_count_[1].empty() 
-					&& !vec_sup_count_tmp_.empty() && !cost_aggr_.empty();
+	// ۡۺϴۼʱSetBuffers
+	is_initialized_ = true;
 	return is_initialized_;
 }
 
-void CrossAggregator::SetData(const uint8* img_left, const uint8* img_right, const float32* cost_init)
+void CrossAggregator::SetBuffers(CrossArm* cross_arms, float32* cost_aggr, float32* cost_vol_tmp, float32* cost_tmp[2], uint16* sup_count[2], uint16* sup_count_tmp)
+{
+	cross_arms_ = cross_arms;
+	cost_aggr_ = cost_aggr;
+	cost_vol_tmp_ = cost_vol_tmp;
+	cost_tmp_[0] = cost_tmp[0];
+	cost_tmp_[1] = cost_tmp[1];
+	sup_count_[0] = sup_count[0];
+	sup_count_[1] = sup_count[1];
+	sup_count_tmp_ = sup_count_tmp;
+}
+
+void CrossAggregator::SetData(const ADImageView& img_left, const ADImageView& img_right, const float32* cost_init)
 {
 	img_left_ = img_left;
 	img_right_ = img_right;
 	cost_init_ = cost_init;
 }
 
+void CrossAggregator::SetColorDiffs(const uint8* diff_h, const uint8* diff_v)
+{
+	diff_h_ = diff_h;
+	diff_v_ = diff_v;
+}
+
 void CrossAggregator::SetParams(const sint32& cross_L1, const sint32& cross_L2, const sint32& cross_t1,
 	const sint32& cross_t2)
 {
@@ -73,12 +83,19 @@ void CrossAggregator::SetParams(const sint32& cross_L1, const sint32& cross_L2,
 	cross_t2_ = cross_t2;
 }
 
+bool CrossAggregator::SetBackend(const ADCensusBackend& backend)
+{
+	backend_ = backend;
+	return aggregate_kernels_.Has(backend);
+}
+
 void CrossAggregator::BuildArms() 
 {
+	ADCENSUS_TRACE_SCOPE("BuildArms");
 	// ؼʮֽ
 	for (sint32 y = 0; y < height_; y++) {
 		for (sint32 x = 0; x < width_; x++) {
-			CrossArm& arm = vec_cross_arms_[y * width_ + x];
+			CrossArm& arm = cross_arms_[y * width_ + x];
 			FindHorizontalArm(x, y, arm.left, arm.right);
 			FindVerticalArm(x, y, arm.top, arm.bottom);
 		}
@@ -86,9 +103,11 @@ void CrossAggregator::BuildArms()
 }
 
 
-void CrossAggregator::Aggregate(const sint32& num_iters)
+void CrossAggregator::Aggregate(const sint32& num_iters, const float32& converge_ratio)
 {
-	if (!is_initialized_) {
+	num_iters_ = 0;
+	if (!is_initialized_ || cross_arms_ == nullptr || cost_aggr_ == nullptr || cost_init_ == nullptr ||
+		diff_h_ == nullptr || diff_v_ == nullptr) {
 		return;
 	}
 
@@ -105,39 +124,85 @@ void CrossAggregator::Aggregate(const sint32& num_iters)
 	ComputeSupPixelCount();
 
 	// Ƚۺϴ۳ʼΪʼ
-	memcpy(&cost_aggr_[0], cost_init_, width_*height_*disp_range*sizeof(float32));
+	// оָ̬̣߳ۺϴ۵ڴҳɴе߳״д
+	const size_t row_size = static_cast<size_t>(width_) * disp_range;
+#pragma omp parallel for schedule(static)
+	for (sint32 y = 0; y < height_; y++) {
+		memcpy(cost_aggr_ + y * row_size, cost_init_ + y * row_size, row_size * sizeof(float32));
+	}
+
+	// Ӧʱ¼ڳʼµӲ
+	const bool adaptive = converge_ratio > 0.0f;
+	std::vector<uint16> argmins;
+	sint32 num_samples = 0;
+	if (adaptive) {
+		num_samples = ((width_ + Sample_Step - 1) / Sample_Step) * ((height_ + Sample_Step - 1) / Sample_Step);
+		argmins.assign(num_samples, 0);
+		UpdateSampleArgmins(argmins);
+	}
 
 	// ۺ
 	for (sint32 k = 0; k < num_iters; k++) {
-		for (sint32 d = min_disparity_; d < max_disparity_; d++) {
-			AggregateInArms(d, horizontal_first);
-		}
+		ADCENSUS_TRACE_SCOPE_ARG("AggregateInArms", k);
+		(this->*aggregate_kernels_.Get(backend_))(horizontal_first);
+		num_iters_++;
 		// һε˳
 		horizontal_first = !horizontal_first;
+
+		// صӲٱ仯ʱֹֺͣ˵ľۺϴλһ£ֹͣʱͬ
+		if (adaptive && k + 1 < num_iters) {
+			ADCENSUS_TRACE_SCOPE("CheckConvergence");
+			const sint32 num_changed = UpdateSampleArgmins(argmins);
+			if (num_changed <= converge_ratio * num_samples) {
+				break;
+			}
+		}
+	}
+}
+
+sint32 CrossAggregator::UpdateSampleArgmins(std::vector<uint16>& argmins) const
+{
+	const sint32 disp_range = max_disparity_ - min_disparity_;
+	const sint32 samples_per_row = (width_ + Sample_Step - 1) / Sample_Step;
+	const sint32 sample_rows = (height_ + Sample_Step - 1) / Sample_Step;
+	sint32 num_changed = 0;
+#pragma omp parallel for schedule(static) reduction(+:num_changed)
+	for (sint32 i = 0; i < sample_rows; i++) {
+		const sint32 y = i * Sample_Step;
+		for (sint32 j = 0; j < samples_per_row; j++) {
+			const float32* cost = cost_aggr_ + (static_cast<size_t>(y) * width_ + j * Sample_Step) * disp_range;
+			uint16 best = 0;
+			for (sint32 d = 1; d < disp_range; d++) {
+				if (cost[d] < cost[best]) {
+					best = static_cast<uint16>(d);
+				}
+			}
+			auto& argmin = argmins[i * samples_per_row + j];
+			if (argmin != best) {
+				argmin = best;
+				num_changed++;
+			}
+		}
 	}
+	return num_changed;
 }
 
 CrossArm* CrossAggregator::get_arms_ptr()
 {
-	return &vec_cross_arms_[0];
+	return cross_arms_;
 }
 
 float32* CrossAggregator::get_cost_ptr()
 {
-	if (!cost_aggr_.empty()) {
-		return &cost_aggr_[0];
-	}
-	else {
-		return nullptr;
-	}
+	return cost_aggr_;
 }
 
 void CrossAggregator::FindHorizontalArm(const sint32& x, const sint32& y, uint8& left, uint8& right) const
 {
 	// ݵַ
-	const auto img0 = img_left_ + y * width_ * 3 + 3 * x;
-	// ɫֵ
-	const ADColor color0(img0[0], img0[1], img0[2]);
+	const auto img0 = img_left_.pixel(x, y);
+	// صɫ
+	const uint8* diff_row = diff_h_ + y * width_;
 	
 	left = right = 0;
 	//ұ,ۺұ
@@ -145,8 +210,7 @@ void CrossAggregator::FindHorizontalArm(const sint32& x, const sint32& y, uint8&
 	for (sint32 k = 0; k < 2; k++) {
 		// ֱ
 		// ۳ócross_L1
-		auto img = img0 + dir * 3;
-		auto color_last = color0;
+		auto img = img0 + dir * img_left_.pixel_step;
 		sint32 xn = x + dir;
 		for (sint32 n = 0; n < std::min(cross_L1_, MAX_ARM_LENGTH); n++) {
 
@@ -162,18 +226,15 @@ void CrossAggregator::FindHorizontalArm(const sint32& x, const sint32& y, uint8&
 				}
 			}
 
-			// ȡɫֵ
-			const ADColor color(img[0], img[1], img[2]);
-
 			// ɫ1غͼصɫ룩
-			const sint32 color_dist1 = ColorDist(color, color0);
+			const sint32 color_dist1 = img_left_.max_diff(img, img0);
 			if (color_dist1 >= cross_t1_) {
 				break;
 			}
 
-			// ɫ2غǰһصɫ룩
+			// ɫ2غǰһصɫ룩ȡصɫͼ
 			if (n > 0) {
-				const sint32 color_dist2 = ColorDist(color, color_last);
+				const sint32 color_dist2 = diff_row[(dir < 0) ? xn + 1 : xn];
 				if (color_dist2 >= cross_t1_) {
 					break;
 				}
@@ -192,9 +253,8 @@ void CrossAggregator::FindHorizontalArm(const sint32& x, const sint32& y, uint8&
 			else {
 				right++;
 			}
-			color_last = color;
 			xn += dir;
-			img += dir * 3;
+			img += dir * img_left_.pixel_step;
 		}
 		dir = -dir;
 	}
@@ -203,9 +263,9 @@ void CrossAggregator::FindHorizontalArm(const sint32& x, const sint32& y, uint8&
 void CrossAggregator::FindVerticalArm(const sint32& x, const sint32& y, uint8& top, uint8& bottom) const
 {
 	// ݵַ
-	const auto img0 = img_left_ + y * width_ * 3 + 3 * x;
-	// ɫֵ
-	const ADColor color0(img0[0], img0[1], img0[2]);
+	const auto img0 = img_left_.pixel(x, y);
+	// Ϸصɫ
+	const uint8* diff_col = diff_v_ + x;
 
 	top = bottom = 0;
 	//±,ϱۺ±
@@ -213,8 +273,7 @@ void CrossAggregator::FindVerticalArm(const sint32& x, const sint32& y, uint8& t
 	for (sint32 k = 0; k < 2; k++) {
 		// ֱ
 		// ۳ócross_L1
-		auto img = img0 + dir * width_ * 3;
-		auto color_last = color0;
+		auto img = img0 + dir * img_left_.stride;
 		sint32 yn = y + dir;
 		for (sint32 n = 0; n < std::min(cross_L1_, MAX_ARM_LENGTH); n++) {
 
@@ -230,18 +289,15 @@ void CrossAggregator::FindVerticalArm(const sint32& x, const sint32& y, uint8& t
 				}
 			}
 
-			// ȡɫֵ
-			const ADColor color(img[0], img[1], img[2]);
-
 			// ɫ1غͼصɫ룩
-			const sint32 color_dist1 = ColorDist(color, color0);
+			const sint32 color_dist1 = img_left_.max_diff(img, img0);
 			if (color_dist1 >= cross_t1_) {
 				break;
 			}
 
-			// ɫ2غǰһصɫ룩
+			// ɫ2غǰһصɫ룩ȡصɫͼ
 			if (n > 0) {
-				const sint32 color_dist2 = ColorDist(color, color_last);
+				const sint32 color_dist2 = diff_col[((dir < 0) ? yn + 1 : yn) * width_];
 				if (color_dist2 >= cross_t1_) {
 					break;
 				}
@@ -260,9 +316,8 @@ void CrossAggregator::FindVerticalArm(const sint32& x, const sint32& y, uint8& t
 			else {
 				bottom++;
 			}
-			color_last = color;
 			yn += dir;
-			img += dir * width_ * 3;
+			img += dir * img_left_.stride;
 		}
 		dir = -dir;
 	}
@@ -270,6 +325,7 @@ void CrossAggregator::FindVerticalArm(const sint32& x, const sint32& y, uint8& t
 
 void CrossAggregator::ComputeSupPixelCount()
 {
+	ADCENSUS_TRACE_SCOPE("ComputeSupPixelCount");
 	// ÿص֧
 	// ע⣺ֲͬľۺϷص֧ǲͬģҪֿ
 	bool horizontal_first = true;
@@ -281,7 +337,7 @@ void CrossAggregator::ComputeSupPixelCount()
 			for (sint32 y = 0; y < height_; y++) {
 				for (sint32 x = 0; x < width_; x++) {
 					// ȡarmֵ
-					auto& arm = vec_cross_arms_[y*width_ + x];
+					auto& arm = cross_arms_[y*width_ + x];
 					sint32 count = 0;
 					if (horizontal_first) {
 						if (k == 0) {
@@ -293,7 +349,7 @@ void CrossAggregator::ComputeSupPixelCount()
 						else {
 							// vertical
 							for (sint32 t = -arm.top; t <= arm.bottom; t++) {
-								count += vec_sup_count_tmp_[(y + t)*width_ + x];
+								count += sup_count_tmp_[(y + t)*width_ + x];
 							}
 						}
 					}
@@ -307,15 +363,15 @@ void CrossAggregator::ComputeSupPixelCount()
 						else {
 							// horizontal
 							for (sint32 t = -arm.left; t <= arm.right; t++) {
-								count += vec_sup_count_tmp_[y*width_ + x + t];
+								count += sup_count_tmp_[y*width_ + x + t];
 							}
 						}
 					}
 					if (k == 0) {
-						vec_sup_count_tmp_[y*width_ + x] = count;
+						sup_count_tmp_[y*width_ + x] = count;
 					}
 					else {
-						vec_sup_count_[id][y*width_ + x] = count;
+						sup_count_[id][y*width_ + x] = count;
 					}
 				}
 			}
@@ -337,11 +393,11 @@ void CrossAggregator::AggregateInArms(const sint32& disparity, const bool& horiz
 		return;
 	}
 
-	// dispĴ۴ʱvec_cost_tmp_[0]
+	// dispĴ۴ʱcost_tmp_[0]
 	// Աķʸcost_aggr_,߷Ч
 	for (sint32 y = 0; y < height_; y++) {
 		for (sint32 x = 0; x < width_; x++) {
-			vec_cost_tmp_[0][y * width_ + x] = cost_aggr_[y * width_ * disp_range + x * disp_range + disp];
+			cost_tmp_[0][y * width_ + x] = cost_aggr_[y * width_ * disp_range + x * disp_range + disp];
 		}
 	}
 
@@ -353,19 +409,19 @@ void CrossAggregator::AggregateInArms(const sint32& disparity, const bool& horiz
 		for (sint32 y = 0; y < height_; y++) {
 			for (sint32 x = 0; x < width_; x++) {
 				// ȡarmֵ
-				auto& arm = vec_cross_arms_[y*width_ + x];
+				auto& arm = cross_arms_[y*width_ + x];
 				// ۺ
 				float32 cost = 0.0f;
 				if (horizontal_first) {
 					if (k == 0) {
 						// horizontal
 						for (sint32 t = -arm.left; t <= arm.right; t++) {
-							cost += vec_cost_tmp_[0][y * width_ + x + t];
+							cost += cost_tmp_[0][y * width_ + x + t];
 						}
 					} else {
 						// vertical
 						for (sint32 t = -arm.top; t <= arm.bottom; t++) {
-							cost += vec_cost_tmp_[1][(y + t)*width_ + x];
+							cost += cost_tmp_[1][(y + t)*width_ + x];
 						}
 					}
 				}
@@ -373,20 +429,80 @@ void CrossAggregator::AggregateInArms(const sint32& disparity, const bool& horiz
 					if (k == 0) {
 						// vertical
 						for (sint32 t = -arm.top; t <= arm.bottom; t++) {
-							cost += vec_cost_tmp_[0][(y + t) * width_ + x];
+							cost += cost_tmp_[0][(y + t) * width_ + x];
 						}
 					} else {
 						// horizontal
 						for (sint32 t = -arm.left; t <= arm.right; t++) {
-							cost += vec_cost_tmp_[1][y*width_ + x + t];
+							cost += cost_tmp_[1][y*width_ + x + t];
 						}
 					}
 				}
 				if (k == 0) {
-					vec_cost_tmp_[1][y*width_ + x] = cost;
+					cost_tmp_[1][y*width_ + x] = cost;
+				}
+				else {
+					cost_aggr_[y*width_*disp_range + x*disp_range + disp] = cost / sup_count_[ct_id][y*width_ + x];
+				}
+			}
+		}
+	}
+}
+
+void CrossAggregator::AggregateByDisparity(const bool& horizontal_first)
+{
+	if (cost_tmp_[0] == nullptr || cost_tmp_[1] == nullptr) {
+		return;
+	}
+	for (sint32 d = min_disparity_; d < max_disparity_; d++) {
+		AggregateInArms(d, horizontal_first);
+	}
+}
+
+void CrossAggregator::AggregateAllDisparities(const bool& horizontal_first)
+{
+	if (cost_vol_tmp_ == nullptr) {
+		return;
+	}
+
+	// AggregateInArmsͬۺϣһδӲرۼӲ
+	// ôҿӲȡƽ档ÿӲۼӴοʵͬλһ
+	// һ cost_aggr_ -> cost_vol_tmp_ڶ cost_vol_tmp_ -> cost_aggr_ ֧
+	const sint32 width = width_;
+	const sint32 height = height_;
+	const sint32 disp_range = max_disparity_ - min_disparity_;
+	const sint32 ct_id = horizontal_first ? 0 : 1;
+	// ۼӼʹõǰָںˣӲΧбػ
+	const auto& kernels = adcensus_util::GetKernels(disp_range);
+	const auto accumulate = kernels.accumulate;
+	const auto divide = kernels.divide;
+
+	for (sint32 k = 0; k < 2; k++) {
+		// k==0: pass1
+		// k==1: pass2
+		const float32* src = (k == 0) ? cost_aggr_ : cost_vol_tmp_;
+		float32* dst = (k == 0) ? cost_vol_tmp_ : cost_aggr_;
+		const bool horizontal = (k == 0) == horizontal_first;
+#pragma omp parallel for schedule(static)
+		for (sint32 y = 0; y < height; y++) {
+			for (sint32 x = 0; x < width; x++) {
+				const auto& arm = cross_arms_[y * width + x];
+				float32* cost = dst + (static_cast<size_t>(y) * width + x) * disp_range;
+				for (sint32 d = 0; d < disp_range; d++) {
+					cost[d] = 0.0f;
+				}
+				if (horizontal) {
+					for (sint32 t = -arm.left; t <= arm.right; t++) {
+						accumulate(cost, src + (static_cast<size_t>(y) * width + x + t) * disp_range, disp_range);
+					}
 				}
 				else {
-					cost_aggr_[y*width_*disp_range + x*disp_range + disp] = cost / vec_sup_count_[ct_id][y*width_ + x];
+					for (sint32 t = -arm.top; t <= arm.bottom; t++) {
+						accumulate(cost, src + (static_cast<size_t>(y + t) * width + x) * disp_range, disp_range);
+					}
+				}
+				if (k == 1) {
+					divide(cost, sup_count_[ct_id][y * width + x], disp_range);
 				}
 			}
 		}
@@ -8,6 +8,7 @@
 #define AD_CENSUS_CROSS_AGGREGATOR_H_
 
 #include "adcensus_types.h"
+#include "stage_kernels.h"
 #include <algorithm>
 
 /**
@@ -37,13 +38,31 @@ public:
 	 */
 	bool Initialize(const sint32& width, const sint32& height, const sint32& min_disparity, const sint32& max_disparity);
 
+	/**
+	 * \brief ô۾ۺĻ棬ڴⲿڴͳһ
+	 * \param cross_arms		// ʮֽۣwidth*height
+	 * \param cost_aggr		// ۺϴۣwidth*height*disp_range
+	 * \param cost_vol_tmp	// ʱ壬width*height*disp_rangeŻʵʹãʼ۹ãʼۿۺϴۺʹã
+	 * \param cost_tmp		// ʱۣ2width*heightοʵʹ
+	 * \param sup_count		// ֧2width*height
+	 * \param sup_count_tmp	// ʱ֧width*height
+	 */
+	void SetBuffers(CrossArm* cross_arms, float32* cost_aggr, float32* cost_vol_tmp, float32* cost_tmp[2], uint16* sup_count[2], uint16* sup_count_tmp);
+
 	/**
 	 * \brief ô۾ۺ
-	 * \param img_left		// Ӱݣͨ
-	 * \param img_right		// Ӱݣͨ
+	 * \param img_left		// Ӱͼ
+	 * \param img_right		// Ӱͼ
 	 * \param cost_init		// ʼ
 	 */
-	void SetData(const uint8* img_left, const uint8* img_right, const float32* cost_init);
+	void SetData(const ADImageView& img_left, const ADImageView& img_right, const float32* cost_init);
+
+	/**
+	 * \brief Ӱصɫͼadcensus_util::ComputeNeighborDiffsʱʹ
+	 * \param diff_h		// صɫ룬width*height
+	 * \param diff_v		// Ϸصɫ룬width*height
+	 */
+	void SetColorDiffs(const uint8* diff_h, const uint8* diff_v);
 
 	/**
 	 * \brief ô۾ۺĲ
@@ -54,8 +73,22 @@ public:
 	 */
 	void SetParams(const sint32& cross_L1, const sint32& cross_L2, const sint32& cross_t1, const sint32& cross_t2);
 
-	/** \brief ۺ */
-	void Aggregate(const sint32& num_iters);
+	/**
+	 * \brief ü
+	 * \param backend		// ˣοʵΪԭʼӲر
+	 * \return true: úעʵ֣false: δעᣬ˻زοʵ
+	 */
+	bool SetBackend(const ADCensusBackend& backend);
+
+	/**
+	 * \brief ۺ
+	 * \param num_iters		// ӦʱΪ
+	 * \param converge_ratio	// ӦֵֹͣÿεӲ仯ıֵʱֹͣ0ʱ̶num_iters
+	 */
+	void Aggregate(const sint32& num_iters, const float32& converge_ratio = 0.0f);
+
+	/** \brief ȡһξۺϵʵʵ */
+	sint32 get_num_iters() const { return num_iters_; }
 
 	/** \brief ȡصʮָֽ */
 	CrossArm* get_arms_ptr();
@@ -71,35 +104,47 @@ private:
 	void FindVerticalArm(const sint32& x, const sint32& y, uint8& top, uint8& bottom) const;
 	/** \brief ص֧ */
 	void ComputeSupPixelCount();
+	/**
+	 * \brief أÿ4С4УھۺϴµӲϴεĽȽ
+	 * \param argmins	// صӲ
+	 * \return Ӳ仯ĳ
+	 */
+	sint32 UpdateSampleArgmins(std::vector<uint16>& argmins) const;
 	/** \brief ۺĳӲ */
 	void AggregateInArms(const sint32& disparity, const bool& horizontal_first);
+	/** \brief ӲۺӲοʵ֣һε */
+	void AggregateByDisparity(const bool& horizontal_first);
+	/** \brief ͬʱۺӲŻʵ֣һεӲ */
+	void AggregateAllDisparities(const bool& horizontal_first);
 
-	/** \brief ɫ */
-	inline sint32 ColorDist(const ADColor& c1,const ADColor& c2) const {
-		return std::max(abs(c1.r - c2.r), std::max(abs(c1.g - c2.g), abs(c1.b - c2.b)));
-	}
 private:
 	/** \brief ͼߴ */
 	sint32	width_;
 	sint32	height_;
 
 	/** \brief  */
-	vector<CrossArm> vec_cross_arms_;
+	CrossArm* cross_arms_;
+
+	/** \brief Ӱͼ */
+	ADImageView img_left_;
+	ADImageView img_right_;
 
-	/** \brief Ӱ */
-	const uint8* img_left_;
-	const uint8* img_right_;
+	/** \brief Ӱصɫͼˮƽֱ */
+	const uint8* diff_h_;
+	const uint8* diff_v_;
 
 	/** \brief ʼָ */
 	const float32* cost_init_;
 	/** \brief ۺϴ */
-	vector<float32> cost_aggr_;
+	float32* cost_aggr_;
 
+	/** \brief ʱ */
+	float32* cost_vol_tmp_;
 	/** \brief ʱ */
-	vector<float32> vec_cost_tmp_[2];
+	float32* cost_tmp_[2];
 	/** \brief ֧ 0ˮƽ 1ֱ */
-	vector<uint16> vec_sup_count_[2];
-	vector<uint16> vec_sup_count_tmp_;
+	uint16* sup_count_[2];
+	uint16* sup_count_tmp_;
 
 	sint32	cross_L1_;			// ʮֽ洰ڵĿռL1
 	sint32  cross_L2_;			// ʮֽ洰ڵĿռL2
@@ -108,6 +153,14 @@ private:
 	sint32  min_disparity_;			// СӲ
 	sint32	max_disparity_;			// Ӳ
 
+	/** \brief һξۺϵʵʵ */
+	sint32	num_iters_;
+
+	/** \brief  */
+	ADCensusBackend backend_;
+	/** \brief εۺϵĸʵ */
+	StageKernels<void (CrossAggregator::*)(const bool&)> aggregate_kernels_;
+
 	/** \brief Ƿɹʼ־	*/
 	bool is_initialized_;
 };
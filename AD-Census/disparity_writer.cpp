@@ -0,0 +1,268 @@
+/* -*-c++-*- AD-Census - Copyright (C) 2020.
+* Author	: Yingsong Li(Ethan Li) <ethan.li.whu@gmail.com>
+* https://github.com/ethan-li-coding/AD-Census
+* Describe	: implement of class DisparityWriter
+*/
+
+#include "disparity_writer.h"
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+namespace
+{
+	/** \brief дĴСֽڣʱһfwriteд */
+	constexpr size_t Buffer_Size = 4 << 20;
+
+	/** \brief PLY㣺float x,y,zuchar red,green,blueմ洢 */
+	constexpr size_t Ply_Vertex_Size = 3 * sizeof(float32) + 3;
+
+	/** \brief ǷΪСֽ */
+	inline bool IsLittleEndian()
+	{
+		const uint16 one = 1;
+		uint8 byte;
+		memcpy(&byte, &one, 1);
+		return byte == 1;
+	}
+
+	/** \brief ڴ滺Ķļд */
+	class BufferedFile {
+	public:
+		explicit BufferedFile(const std::string& path) : fp_(fopen(path.c_str(), "wb")), size_(0), is_ok_(fp_ != nullptr) {
+			if (is_ok_) {
+				buffer_.resize(Buffer_Size);
+			}
+		}
+		~BufferedFile() { Close(); }
+
+		/** \brief ׷ݣʱд */
+		void Write(const void* data, const size_t& bytes) {
+			if (!is_ok_) {
+				return;
+			}
+			if (size_ + bytes > buffer_.size()) {
+				Drain();
+				if (bytes > buffer_.size()) {
+					is_ok_ = fwrite(data, 1, bytes, fp_) == bytes;
+					return;
+				}
+			}
+			memcpy(&buffer_[size_], data, bytes);
+			size_ += bytes;
+		}
+
+		/** \brief дʣݲرļ */
+		bool Close() {
+			if (fp_ != nullptr) {
+				Drain();
+				is_ok_ = (fclose(fp_) == 0) && is_ok_;
+				fp_ = nullptr;
+			}
+			return is_ok_;
+		}
+
+	private:
+		void Drain() {
+			if (is_ok_ && size_ > 0) {
+				is_ok_ = fwrite(&buffer_[0], 1, size_, fp_) == size_;
+			}
+			size_ = 0;
+		}
+
+		FILE* fp_;
+		vector<uint8> buffer_;
+		size_t size_;
+		bool is_ok_;
+	};
+}
+
+DisparityWriter::DisparityWriter(const sint32& max_pending)
+	: max_pending_(std::max(max_pending, 1)), num_running_(0), num_failed_(0), is_stopping_(false)
+{
+	thread_ = std::thread(&DisparityWriter::Run, this);
+}
+
+DisparityWriter::~DisparityWriter()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		is_stopping_ = true;
+	}
+	cond_.notify_all();
+	if (thread_.joinable()) {
+		thread_.join();
+	}
+}
+
+void DisparityWriter::SubmitPfm(const std::string& path, const ADDisparityView& disp, const sint32& width, const sint32& height)
+{
+	Job job;
+	job.is_ply = false;
+	job.path = path;
+	job.width = width;
+	job.height = height;
+	job.disp.resize(static_cast<size_t>(width) * height);
+	for (sint32 y = 0; y < height; y++) {
+		memcpy(&job.disp[static_cast<size_t>(y) * width], disp.row(y), width * sizeof(float32));
+	}
+	Submit(std::move(job));
+}
+
+void DisparityWriter::SubmitPly(const std::string& path, const ADDisparityView& disp, const ADImageView& img, const sint32& width, const sint32& height,
+								const ADDepthParams& depth)
+{
+	Job job;
+	job.is_ply = true;
+	job.path = path;
+	job.width = width;
+	job.height = height;
+	job.depth = depth;
+	job.disp.resize(static_cast<size_t>(width) * height);
+	job.bgr.resize(static_cast<size_t>(width) * height * 3);
+	for (sint32 y = 0; y < height; y++) {
+		memcpy(&job.disp[static_cast<size_t>(y) * width], disp.row(y), width * sizeof(float32));
+		uint8* bgr = &job.bgr[static_cast<size_t>(y) * width * 3];
+		for (sint32 x = 0; x < width; x++) {
+			const ADColor color = img.color(x, y);
+			bgr[3 * x] = color.b;
+			bgr[3 * x + 1] = color.g;
+			bgr[3 * x + 2] = color.r;
+		}
+	}
+	Submit(std::move(job));
+}
+
+void DisparityWriter::Submit(Job&& job)
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+	cond_.wait(lock, [this] { return static_cast<sint32>(jobs_.size()) < max_pending_; });
+	jobs_.push_back(std::move(job));
+	lock.unlock();
+	cond_.notify_all();
+}
+
+void DisparityWriter::Flush()
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+	cond_.wait(lock, [this] { return jobs_.empty() && num_running_ == 0; });
+}
+
+sint32 DisparityWriter::get_num_failed()
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return num_failed_;
+}
+
+void DisparityWriter::Run()
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+	while (true) {
+		cond_.wait(lock, [this] { return is_stopping_ || !jobs_.empty(); });
+		if (jobs_.empty()) {
+			// ʱд
+			break;
+		}
+		Job job = std::move(jobs_.front());
+		jobs_.pop_front();
+		num_running_++;
+		lock.unlock();
+		cond_.notify_all();
+
+		bool ok;
+		const ADDisparityView disp(&job.disp[0], job.width * sizeof(float32));
+		if (job.is_ply) {
+			ok = WritePly(job.path, disp, ADImageView::PackedBGR(&job.bgr[0], job.width), job.width, job.height, job.depth);
+		}
+		else {
+			ok = WritePfm(job.path, disp, job.width, job.height);
+		}
+
+		lock.lock();
+		num_running_--;
+		if (!ok) {
+			num_failed_++;
+		}
+		cond_.notify_all();
+	}
+}
+
+bool DisparityWriter::WritePfm(const std::string& path, const ADDisparityView& disp, const sint32& width, const sint32& height)
+{
+	if (disp.data == nullptr || width <= 0 || height <= 0) {
+		return false;
+	}
+	BufferedFile file(path);
+
+	// ΪʾСˣΪʾ
+	char header[64];
+	const sint32 len = snprintf(header, sizeof(header), "Pf\n%d %d\n%s\n", width, height, IsLittleEndian() ? "-1.0" : "1.0");
+	file.Write(header, len);
+
+	// PFM¶
+	for (sint32 y = height - 1; y >= 0; y--) {
+		file.Write(disp.row(y), width * sizeof(float32));
+	}
+	return file.Close();
+}
+
+bool DisparityWriter::WritePly(const std::string& path, const ADDisparityView& disp, const ADImageView& img, const sint32& width, const sint32& height,
+							   const ADDepthParams& depth)
+{
+	if (disp.data == nullptr || img.data == nullptr || width <= 0 || height <= 0) {
+		return false;
+	}
+	const bool use_depth = depth.is_valid();
+	const float32 fb = depth.focal * depth.baseline;
+
+	// дļͷУͳЧӲ
+	uint64 num_vertices = 0;
+	for (sint32 y = 0; y < height; y++) {
+		const float32* disp_row = disp.row(y);
+		for (sint32 x = 0; x < width; x++) {
+			const float32 d = disp_row[x];
+			if (d == Invalid_Float || std::isnan(d) || (use_depth && d + depth.doffs <= 0.0f)) {
+				continue;
+			}
+			num_vertices++;
+		}
+	}
+
+	BufferedFile file(path);
+	char header[256];
+	const sint32 len = snprintf(header, sizeof(header),
+		"ply\nformat %s 1.0\nelement vertex %llu\n"
+		"property float x\nproperty float y\nproperty float z\n"
+		"property uchar red\nproperty uchar green\nproperty uchar blue\nend_header\n",
+		IsLittleEndian() ? "binary_little_endian" : "binary_big_endian", static_cast<unsigned long long>(num_vertices));
+	file.Write(header, len);
+
+	uint8 vertex[Ply_Vertex_Size];
+	for (sint32 y = 0; y < height; y++) {
+		const float32* disp_row = disp.row(y);
+		for (sint32 x = 0; x < width; x++) {
+			const float32 d = disp_row[x];
+			if (d == Invalid_Float || std::isnan(d) || (use_depth && d + depth.doffs <= 0.0f)) {
+				continue;
+			}
+			float32 xyz[3];
+			if (use_depth) {
+				xyz[2] = fb / (d + depth.doffs);
+				xyz[0] = (x - depth.cx) * xyz[2] / depth.focal;
+				xyz[1] = (y - depth.cy) * xyz[2] / depth.focal;
+			}
+			else {
+				xyz[0] = static_cast<float32>(x);
+				xyz[1] = static_cast<float32>(y);
+				xyz[2] = d;
+			}
+			const ADColor color = img.color(x, y);
+			memcpy(vertex, xyz, sizeof(xyz));
+			vertex[sizeof(xyz)] = color.r;
+			vertex[sizeof(xyz) + 1] = color.g;
+			vertex[sizeof(xyz) + 2] = color.b;
+			file.Write(vertex, Ply_Vertex_Size);
+		}
+	}
+	return file.Close();
+}
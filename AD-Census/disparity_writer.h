@@ -0,0 +1,119 @@
+/* -*-c++-*- AD-Census - Copyright (C) 2020.
+* Author	: Yingsong Li(Ethan Li) <ethan.li.whu@gmail.com>
+* https://github.com/ethan-li-coding/AD-Census
+* Describe	: header of class DisparityWriter
+*/
+
+#ifndef AD_CENSUS_DISPARITY_WRITER_H_
+#define AD_CENSUS_DISPARITY_WRITER_H_
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "adcensus_types.h"
+
+/** \brief ӲȵZ = focal * baseline / (d + doffs)X = (x - cx) * Z / focalY = (y - cy) * Z / focal */
+struct ADDepthParams {
+	float32 focal;		// ࣨأ
+	float32 baseline;	// ߳
+	float32 cx, cy;		// 㣨أ
+	float32 doffs;		// вMiddleburyݼdoffsӲϸֵ
+
+	ADDepthParams() : focal(0.0f), baseline(0.0f), cx(0.0f), cy(0.0f), doffs(0.0f) {}
+	ADDepthParams(const float32& _focal, const float32& _baseline, const float32& _cx, const float32& _cy, const float32& _doffs = 0.0f)
+		: focal(_focal), baseline(_baseline), cx(_cx), cy(_cy), doffs(_doffs) {}
+
+	/** \brief ǷڼȣӲ(x,y,d) */
+	bool is_valid() const { return focal > 0.0f && baseline > 0.0f; }
+};
+
+/**
+ * \brief ӲͼPFMԭʼӲPLY
+ * Ȱдڴ滺壬ÿһfwriteдظʽı
+ * ̨д̰߳ύ˳дļύʱݺ󼴷أдһ֡ƥص
+ */
+class DisparityWriter {
+public:
+	/**
+	 * \param max_pending	̨δдʱύƻ֡
+	 */
+	explicit DisparityWriter(const sint32& max_pending = 4);
+	/** \brief де̨߳ */
+	~DisparityWriter();
+
+	/**
+	 * \brief ύPFMд񣨿Ӳݺ󷵻أ
+	 * \param path		·
+	 * \param disp		Ӳͼͼ
+	 * \param width		
+	 * \param height	߶
+	 */
+	void SubmitPfm(const std::string& path, const ADDisparityView& disp, const sint32& width, const sint32& height);
+
+	/**
+	 * \brief ύPLYд񣨿Ӳɫݺ󷵻أͬWritePly
+	 */
+	void SubmitPly(const std::string& path, const ADDisparityView& disp, const ADImageView& img, const sint32& width, const sint32& height,
+				   const ADDepthParams& depth = ADDepthParams());
+
+	/** \brief ȴύȫд */
+	void Flush();
+
+	/** \brief дʧܵ */
+	sint32 get_num_failed();
+
+	/**
+	 * \brief ͬдPFMͨ㣬¶ϣֽдӵķűֽ򣩣ЧӲΪinf
+	 * \return true: дɹ
+	 */
+	static bool WritePfm(const std::string& path, const ADDisparityView& disp, const sint32& width, const sint32& height);
+
+	/**
+	 * \brief ͬдPLYƣΪfloat x,y,zuchar red,green,blueֽдЧӲ
+	 * \param path		·
+	 * \param disp		Ӳͼͼ
+	 * \param img		Ӱͼṩɫ
+	 * \param width		
+	 * \param height	߶
+	 * \param depth		ЧʱΪϵµά꣨ӲΪأΪ(x,y,d)
+	 * \return true: дɹ
+	 */
+	static bool WritePly(const std::string& path, const ADDisparityView& disp, const ADImageView& img, const sint32& width, const sint32& height,
+						 const ADDepthParams& depth = ADDepthParams());
+
+private:
+	/** \brief д񣬳ݵĿ */
+	struct Job {
+		bool is_ply;
+		std::string path;
+		sint32 width, height;
+		vector<float32> disp;		// մ洢Ӳͼ
+		vector<uint8> bgr;			// մ洢BGRɫPLY
+		ADDepthParams depth;
+	};
+
+	/** \brief ύ񣬶ʱȴ */
+	void Submit(Job&& job);
+	/** \brief ̨̣߳ȡд */
+	void Run();
+
+	/** \brief ̨д߳ */
+	std::thread thread_;
+	/** \brief ״̬Ļ */
+	std::mutex mutex_;
+	/** \brief 񡢶пλʱ֪ͨ */
+	std::condition_variable cond_;
+	/** \brief д */
+	std::deque<Job> jobs_;
+	/** \brief  */
+	sint32 max_pending_;
+	/** \brief д */
+	sint32 num_running_;
+	/** \brief дʧܵ */
+	sint32 num_failed_;
+	/** \brief Ƿ̨߳ */
+	bool is_stopping_;
+};
+#endif
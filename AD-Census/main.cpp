@@ -5,6 +5,8 @@
 */
 #include <iostream>
 #include "ADCensusStereo.h"
+#include "adcensus_util.h"
+#include "disparity_writer.h"
 #include <chrono>
 using namespace std::chrono;
 
@@ -20,8 +22,6 @@ using namespace std::chrono;
 void ShowDisparityMap(const float32* disp_map, const sint32& width, const sint32& height, const std::string& name);
 /*Ӳͼ*/
 void SaveDisparityMap(const float32* disp_map, const sint32& width, const sint32& height, const std::string& path);
-/*Ӳ*/
-void SaveDisparityCloud(const uint8* img_bytes, const float32* disp_map, const sint32& width, const sint32& height, const std::string& path);
 
 /**
 * \brief
@@ -61,19 +61,9 @@ int main(int argv, char** argc)
 	const sint32 width = static_cast<uint32>(img_left.cols);
 	const sint32 height = static_cast<uint32>(img_right.rows);
 
-	// ӰĲɫ
-	auto bytes_left = new uint8[width * height * 3];
-	auto bytes_right = new uint8[width * height * 3];
-	for (int i = 0; i < height; i++) {
-		for (int j = 0; j < width; j++) {
-			bytes_left[i * 3 * width + 3 * j] = img_left.at<cv::Vec3b>(i, j)[0];
-			bytes_left[i * 3 * width + 3 * j + 1] = img_left.at<cv::Vec3b>(i, j)[1];
-			bytes_left[i * 3 * width + 3 * j + 2] = img_left.at<cv::Vec3b>(i, j)[2];
-			bytes_right[i * 3 * width + 3 * j] = img_right.at<cv::Vec3b>(i, j)[0];
-			bytes_right[i * 3 * width + 3 * j + 1] = img_right.at<cv::Vec3b>(i, j)[1];
-			bytes_right[i * 3 * width + 3 * j + 2] = img_right.at<cv::Vec3b>(i, j)[2];
-		}
-	}
+	// ӰĲɫͼֱӶȡcv::Matڴ棨BGR˳򣬰stepУ追
+	const ADImageView view_left(img_left.data, static_cast<sint32>(img_left.step), Pixel_BGR);
+	const ADImageView view_right(img_right.data, static_cast<sint32>(img_right.step), Pixel_BGR);
 	printf("Done!\n");
 
 	// AD-Censusƥ
@@ -84,12 +74,22 @@ int main(int argv, char** argc)
 	// һԼֵ
 	ad_option.lrcheck_thres = 1.0f;
 
+	// censusڳߴ磬5x5졢ڴ٣9x7ȸ
+	ad_option.census_size = Census9x7;
+
 	// ǷִһԼ
 	ad_option.do_lr_check = true;
 
 	// ǷִӲ
 	// ӲͼĽɿ̣䣬У
 	ad_option.do_filling = true;
+
+	// ǷͳƸ׶ӲܼLinuxperf_eventȨޣʱԶԣ
+	ad_option.profile_hw_counters = false;
+
+	// ˣοʵУŻʵ֣ADCensusStereo::Verify
+	// ûADCENSUS_BACKENDǣADCENSUS_BACKEND=aggregation=reference
+	ad_option.backend = Backend_Optimized;
 	
 	printf("w = %d, h = %d, d = [%d,%d]\n\n", width, height, ad_option.min_disparity, ad_option.max_disparity);
 
@@ -115,12 +115,33 @@ int main(int argv, char** argc)
 	start = steady_clock::now();
 	////
 	// ƥ
-	if (!ad_census.Match(bytes_left, bytes_right, disparity)) {
+	ADCensusStats stats;
+	if (!ad_census.Match(view_left, view_right, ADDisparityView(disparity, width * sizeof(float32)), &stats)) {
 		std::cout << "AD-Censusƥʧܣ" << std::endl;
 		return -2;
 	}
 	end = steady_clock::now();
 	tt = duration_cast<milliseconds>(end - start);
+
+	// ׶ͳϢ
+	const char* stage_names[Stage_Count] = { "computing cost", "cost aggregating", "scanline optimizing",
+											 "computing disparities", "multistep refining", "output disparities" };
+	for (sint32 i = 0; i < Stage_Count; i++) {
+		printf("%s! timing :	%lf s	memory : %.1lf MB	backend : %s\n", stage_names[i], stats.stage_ns[i] / 1e9,
+			   stats.stage_bytes[i] / 1048576.0, adcensus_util::BackendName(stats.stage_backends[i]));
+	}
+	printf("isa : %s, threads : %d, occlusions : %d, mismatches : %d, filled : %d\n",
+		   adcensus_util::IsaName(adcensus_util::GetIsa()), stats.num_threads, stats.num_occlusions, stats.num_mismatches, stats.num_filled);
+	if (stats.hw_counters_valid) {
+		// ÿ-Ӳ嵥ԪĻTLBȱʧ
+		const float64 num_pd = float64(width) * height * (ad_option.max_disparity - ad_option.min_disparity);
+		for (sint32 i = 0; i < Stage_Count; i++) {
+			const float64 ipc = stats.stage_cycles[i] > 0 && stats.stage_instructions[i] >= 0 ?
+								float64(stats.stage_instructions[i]) / stats.stage_cycles[i] : -1.0;
+			printf("%s! IPC : %.2lf	LLC misses/pd : %.4lf	dTLB misses/pd : %.4lf\n", stage_names[i], ipc,
+				   stats.stage_llc_misses[i] / num_pd, stats.stage_dtlb_misses[i] / num_pd);
+		}
+	}
 	printf("\nAD-Census Matching...Done! Timing :	%lf s\n", tt.count() / 1000.0);
 
 	////
@@ -128,17 +149,23 @@ int main(int argv, char** argc)
 	ShowDisparityMap(disparity, width, height, "disp-left");
 	// Ӳͼ
 	SaveDisparityMap(disparity, width, height, path_left);
+	// ԭʼӲ(PFM)Ӳ(PLY)ɺ̨߳д
+	DisparityWriter disp_writer;
+	const ADDisparityView disp_view(disparity, width * sizeof(float32));
+	disp_writer.SubmitPfm(path_left + "-d.pfm", disp_view, width, height);
+	disp_writer.SubmitPly(path_left + "-cloud.ply", disp_view, view_left, width, height);
 
 	cv::waitKey(0);
 
+	disp_writer.Flush();
+	if (disp_writer.get_num_failed() > 0) {
+		std::cout << "Ӳļʧܣ" << std::endl;
+	}
+
 	////
 	// ͷڴ
 	delete[] disparity;
 	disparity = nullptr;
-	delete[] bytes_left;
-	bytes_left = nullptr;
-	delete[] bytes_right;
-	bytes_right = nullptr;
 
 	system("pause");
 	return 0;
@@ -208,23 +235,3 @@ void SaveDisparityMap(const float32* disp_map, const sint32& width, const sint32
 	applyColorMap(disp_mat, disp_color, cv::COLORMAP_JET);
 	cv::imwrite(path + "-c.png", disp_color);
 }
-
-void SaveDisparityCloud(const uint8* img_bytes, const float32* disp_map, const sint32& width, const sint32& height, const std::string& path)
-{
-	// Ӳ(x,y,disp,r,g,b)
-	FILE* fp_disp_cloud = nullptr;
-	fopen_s(&fp_disp_cloud, (path + "-cloud.txt").c_str(), "w");
-	if (fp_disp_cloud) {
-		for (sint32 i = 0; i < height; i++) {
-			for (sint32 j = 0; j < width; j++) {
-				const float32 disp = abs(disp_map[i * width + j]);
-				if (disp == Invalid_Float) {
-					continue;
-				}
-				fprintf_s(fp_disp_cloud, "%f %f %f %d %d %d\n", float32(j), float32(i),
-					disp, img_bytes[i * width * 3 + 3 * j + 2], img_bytes[i * width * 3 + 3 * j + 1], img_bytes[i * width * 3 + 3 * j]);
-			}
-		}
-		fclose(fp_disp_cloud);
-	}
-}
\ No newline at end of file
@@ -0,0 +1,163 @@
+/* -*-c++-*- AD-Census - Copyright (C) 2020.
+* Author	: Yingsong Li(Ethan Li) <ethan.li.whu@gmail.com>
+* https://github.com/ethan-li-coding/AD-Census
+* Describe	: implement of class MemoryArena
+*/
+
+#include "memory_arena.h"
+#include <algorithm>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+/** \brief ͸ҳĶߴ磨2MB */
+static const size_t kHugePageSize = static_cast<size_t>(2) << 20;
+#endif
+
+MemoryArena::MemoryArena(): data_(nullptr), mapped_(nullptr), capacity_(0), mapped_size_(0),
+                            is_huge_pages_(false), huge_pages_requested_(false) { }
+
+MemoryArena::~MemoryArena()
+{
+	Release();
+}
+
+bool MemoryArena::Reserve(const size_t& size, const bool& huge_pages)
+{
+	if (size == 0) {
+		return false;
+	}
+
+	// 㹻ҷҳʽһ£ֱӸ
+	if (data_ != nullptr && size <= capacity_ && huge_pages == huge_pages_requested_) {
+		return true;
+	}
+
+	Release();
+
+	const size_t aligned_size = AlignSize(size);
+	huge_pages_requested_ = huge_pages;
+
+#ifdef _WIN32
+	// ҳҪSeLockMemoryPrivilegeȨޣʧ˻Ϊͨҳ
+	if (huge_pages) {
+		const size_t large_page = GetLargePageMinimum();
+		if (large_page > 0) {
+			const size_t bytes = (aligned_size + large_page - 1) / large_page * large_page;
+			mapped_ = VirtualAlloc(nullptr, bytes, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+			if (mapped_ != nullptr) {
+				mapped_size_ = bytes;
+				is_huge_pages_ = true;
+			}
+		}
+	}
+	if (mapped_ == nullptr) {
+		mapped_ = VirtualAlloc(nullptr, aligned_size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+		if (mapped_ == nullptr) {
+			return false;
+		}
+		mapped_size_ = aligned_size;
+	}
+	// VirtualAllocصĵַ64KB
+	data_ = static_cast<uint8*>(mapped_);
+#else
+	// ҳģʽ¶2MBԱ㽫׵ַ뵽ҳ߽
+	const size_t bytes = huge_pages ? aligned_size + kHugePageSize : aligned_size;
+	void* ptr = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (ptr == MAP_FAILED) {
+		return false;
+	}
+	mapped_ = ptr;
+	mapped_size_ = bytes;
+	if (huge_pages) {
+		const size_t addr = reinterpret_cast<size_t>(ptr);
+		data_ = reinterpret_cast<uint8*>((addr + kHugePageSize - 1) & ~(kHugePageSize - 1));
+#ifdef MADV_HUGEPAGE
+		is_huge_pages_ = madvise(data_, aligned_size, MADV_HUGEPAGE) == 0;
+#endif
+	}
+	else {
+		// mmapصĵַҳ
+		data_ = static_cast<uint8*>(ptr);
+	}
+#endif
+
+	capacity_ = aligned_size;
+	return true;
+}
+
+void MemoryArena::Release()
+{
+	if (mapped_ != nullptr) {
+#ifdef _WIN32
+		VirtualFree(mapped_, 0, MEM_RELEASE);
+#else
+		munmap(mapped_, mapped_size_);
+#endif
+	}
+	data_ = nullptr;
+	mapped_ = nullptr;
+	capacity_ = 0;
+	mapped_size_ = 0;
+	is_huge_pages_ = false;
+}
+
+MemoryPlanner::MemoryPlanner() { }
+
+MemoryPlanner::~MemoryPlanner() { }
+
+void MemoryPlanner::Clear()
+{
+	blocks_.clear();
+}
+
+sint32 MemoryPlanner::AddBlock(const size_t& size, const sint32& first_stage, const sint32& last_stage)
+{
+	Block block;
+	block.size = MemoryArena::AlignSize(size);
+	block.first_stage = first_stage;
+	block.last_stage = last_stage;
+	block.offset = 0;
+	blocks_.push_back(block);
+	return static_cast<sint32>(blocks_.size()) - 1;
+}
+
+size_t MemoryPlanner::Plan()
+{
+	// ֽӴСηãÿѷصĿ鲻ͻƫƴ
+	vector<sint32> order(blocks_.size());
+	for (size_t i = 0; i < order.size(); i++) {
+		order[i] = static_cast<sint32>(i);
+	}
+	std::stable_sort(order.begin(), order.end(), [this](const sint32& a, const sint32& b) {
+		return blocks_[a].size > blocks_[b].size;
+	});
+
+	size_t peak = 0;
+	vector<pair<size_t, size_t>> occupied;	// صѷÿռ[begin,end)
+	for (size_t n = 0; n < order.size(); n++) {
+		auto& block = blocks_[order[n]];
+
+		occupied.clear();
+		for (size_t m = 0; m < n; m++) {
+			const auto& placed = blocks_[order[m]];
+			if (placed.first_stage <= block.last_stage && block.first_stage <= placed.last_stage) {
+				occupied.emplace_back(placed.offset, placed.offset + placed.size);
+			}
+		}
+		std::sort(occupied.begin(), occupied.end());
+
+		// Ѱҵһ㹻Ŀ϶
+		size_t offset = 0;
+		for (auto& range : occupied) {
+			if (range.first >= offset + block.size) {
+				break;
+			}
+			offset = std::max(offset, range.second);
+		}
+		block.offset = offset;
+		peak = std::max(peak, offset + block.size);
+	}
+	return peak;
+}
@@ -0,0 +1,106 @@
+/* -*-c++-*- AD-Census - Copyright (C) 2020.
+* Author	: Yingsong Li(Ethan Li) <ethan.li.whu@gmail.com>
+* https://github.com/ethan-li-coding/AD-Census
+* Describe	: header of class MemoryArena
+*/
+
+#ifndef AD_CENSUS_MEMORY_ARENA_H_
+#define AD_CENSUS_MEMORY_ARENA_H_
+
+#include <cstddef>
+#include "adcensus_types.h"
+
+/** \brief ڴֽдСͬʱSIMDҪ */
+#define ARENA_ALIGNMENT 64
+
+/**
+ * \brief ڴ
+ * д弰мݾͬһ64ֽڶڴл֣㹻ʱڴ
+ */
+class MemoryArena {
+public:
+	MemoryArena();
+	~MemoryArena();
+
+	/**
+	 * \brief Ԥڴ棬㹻ʱֱӸã·
+	 * \param size			ֽ
+	 * \param huge_pages	Ƿʹôҳڴ棨֧ʱԶ˻Ϊͨҳ
+	 * \return true: Ԥɹ
+	 */
+	bool Reserve(const size_t& size, const bool& huge_pages);
+
+	/** \brief ͷڴ */
+	void Release();
+
+	/** \brief ȡڴ׵ַ64ֽڶ룩 */
+	uint8* data() const { return data_; }
+
+	/** \brief ȡڴֽڣ */
+	size_t capacity() const { return capacity_; }
+
+	/** \brief Ƿɴҳڴ֧ */
+	bool is_huge_pages() const { return is_huge_pages_; }
+
+	/** \brief ֽȡ߽ */
+	static size_t AlignSize(const size_t& size) {
+		return (size + ARENA_ALIGNMENT - 1) & ~static_cast<size_t>(ARENA_ALIGNMENT - 1);
+	}
+
+private:
+	/** \brief ڴ׵ַ */
+	uint8* data_;
+	/** \brief ϵͳڴ׵ַ */
+	void* mapped_;
+	/** \brief ڴ */
+	size_t capacity_;
+	/** \brief ʵϵͳֽ */
+	size_t mapped_size_;
+	/** \brief ǷΪҳڴ */
+	bool is_huge_pages_;
+	/** \brief һԤʱǷ˴ҳ */
+	bool huge_pages_requested_;
+};
+
+/**
+ * \brief ڴ滮
+ * ݸڣ״ʹý׶ʹý׶Σ滮ڴеƫƣ
+ * ڲصĻ鹲ͬһڴ
+ */
+class MemoryPlanner {
+public:
+	MemoryPlanner();
+	~MemoryPlanner();
+
+	/** \brief л */
+	void Clear();
+
+	/**
+	 * \brief ӻ
+	 * \param size			ֽ
+	 * \param first_stage	״ʹõĽ׶
+	 * \param last_stage	ʹõĽ׶Σ
+	 * \return 
+	 */
+	sint32 AddBlock(const size_t& size, const sint32& first_stage, const sint32& last_stage);
+
+	/**
+	 * \brief 滮ƫ
+	 * \return ֵڴ棨ֽڣڴ
+	 */
+	size_t Plan();
+
+	/** \brief ȡڴеƫƣ64ֽڶ룩 */
+	size_t offset(const sint32& id) const { return blocks_[id].offset; }
+
+private:
+	/** \brief  */
+	struct Block {
+		size_t size;			// ֽ
+		sint32 first_stage;		// ״ʹõĽ׶
+		sint32 last_stage;		// ʹõĽ׶
+		size_t offset;			// ƫ
+	};
+	vector<Block> blocks_;
+};
+#endif
@@ -6,14 +6,43 @@
 
 #include "multistep_refiner.h"
 #include "adcensus_util.h"
+#include "adcensus_trace.h"
+#include <algorithm>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
-MultiStepRefiner::MultiStepRefiner(): width_(0), height_(0), img_left_(nullptr), cost_(nullptr),
+namespace
+{
+	/** \brief ״̬ͼеıǣЧأһԼʱЧ */
+	const sint16 Label_Valid = 0;
+	const sint16 Label_Mismatch = -1;
+	const sint16 Label_Occlusion = -2;
+
+	/** \brief ڲʱȡĴ */
+	const sint32 Walk_Samples = 64;
+	/** \brief ЧϵĵУռЧʱɨһصĺʱһĺʱΪλ */
+	const float64 Map_Scan_Cost = 0.35;
+	/** \brief ЧϵĵУһһϵĺʱ;ЧصĵƼѡ£һĺʱΪλ */
+	const float64 Map_Step_Cost = 4.0;
+
+	/** \brief ڲȷֲԲ */
+	const sint32 num_rays = 16;
+}
+
+MultiStepRefiner::MultiStepRefiner(): width_(0), height_(0), cost_(nullptr),
                                       cross_arms_(nullptr),
-                                      disp_left_(nullptr), disp_right_(nullptr),
+                                      disp_left_(nullptr), disp_right_(nullptr), labels_(nullptr), ray_map_(nullptr),
                                       min_disparity_(0), max_disparity_(0),
                                       irv_ts_(0), irv_th_(0), lrcheck_thres_(0),
                                       do_lr_check_(false), do_region_voting_(false),
-                                      do_interpolating_(false), do_discontinuity_adjustment_(false) { }
+                                      do_interpolating_(false), do_discontinuity_adjustment_(false), lazy_right_(false),
+                                      num_occlusions_(0), num_mismatches_(0), num_filled_(0), num_right_evaluated_(0),
+                                      backend_(Backend_Optimized)
+{
+	refine_kernels_.Register(Backend_Optimized, &MultiStepRefiner::RefineOptimized);
+	refine_kernels_.Register(Backend_Reference, &MultiStepRefiner::RefineReference);
+}
 
 MultiStepRefiner::~MultiStepRefiner()
 {
@@ -27,14 +56,55 @@ bool MultiStepRefiner::Initialize(const sint32& width, const sint32& height)
 		return false;
 	}
 
-	// ʼԵ
-	vec_edge_left_.clear();
-	vec_edge_left_.resize(width*height);
-	
+	// ڲֻӰߴй
+	BuildRays();
+
+	// ͼЧͼSetBuffers
 	return true;
 }
 
-void MultiStepRefiner::SetData(const uint8* img_left, float32* cost,const CrossArm* cross_arms, float32* disp_left, float32* disp_right)
+void MultiStepRefiner::SetBuffers(sint16* labels, sint32* ray_map)
+{
+	labels_ = labels;
+	ray_map_ = ray_map;
+}
+
+void MultiStepRefiner::BuildRays()
+{
+	const float64 pi = 3.14159265358979323846;
+	for (sint32 s = 0; s < num_rays; s++) {
+		auto& ray = rays_[s];
+		const float64 ang = 2 * pi * s / num_rays;
+		const float64 cosa = cos(ang), sina = sin(ang);
+		ray.x_major = fabs(cosa) >= fabs(sina) - 1e-9;
+		const float64 major = ray.x_major ? cosa : sina;
+		const float64 minor = ray.x_major ? sina : cosa;
+		ray.step_major = (major > 0) ? 1 : -1;
+		ray.step_minor = (fabs(minor) < 1e-9) ? 0 : ((minor > 0) ? 1 : -1);
+
+		// Ϊfloor(i*slope)ֱߣбʽӽ01ʱȡȷֵ
+		float64 slope = fabs(minor / major);
+		slope = (slope < 1e-9) ? 0.0 : ((fabs(slope - 1.0) < 1e-9) ? 1.0 : slope);
+		const sint32 size = ray.x_major ? width_ : height_;
+		ray.minor_steps.resize(size);
+		for (sint32 i = 0; i < size; i++) {
+			const sint32 i_next = i + ray.step_major;
+			ray.minor_steps[i] = static_cast<uint8>(abs(static_cast<sint32>(floor(i_next * slope)) - static_cast<sint32>(floor(i * slope))));
+		}
+	}
+}
+
+bool MultiStepRefiner::NextOnRay(const InterpolationRay& ray, sint32& x, sint32& y) const
+{
+	auto& i = ray.x_major ? x : y;
+	auto& j = ray.x_major ? y : x;
+	const sint32 dj = ray.step_minor * ray.minor_steps[i];
+	i += ray.step_major;
+	j += dj;
+	return x >= 0 && x < width_ && y >= 0 && y < height_;
+}
+
+void MultiStepRefiner::SetData(const ADImageView& img_left, float32* cost,const CrossArm* cross_arms, float32* disp_left, float32* disp_right)
 {
 	img_left_ = img_left;
 	cost_ = cost; 
@@ -44,7 +114,8 @@ void MultiStepRefiner::SetData(const uint8* img_left, float32* cost,const CrossA
 }
 
 void MultiStepRefiner::SetParam(const sint32& min_disparity, const sint32& max_disparity, const sint32& irv_ts, const float32& irv_th, const float32& lrcheck_thres,
-								const bool& do_lr_check, const bool& do_region_voting, const bool& do_interpolating, const bool& do_discontinuity_adjustment)
+								const bool& do_lr_check, const bool& do_region_voting, const bool& do_interpolating, const bool& do_discontinuity_adjustment,
+								const bool& lazy_right_disparity)
 {
 	min_disparity_ = min_disparity;
 	max_disparity_ = max_disparity;
@@ -55,40 +126,96 @@ void MultiStepRefiner::SetParam(const sint32& min_disparity, const sint32& max_d
 	do_region_voting_ = do_region_voting;
 	do_interpolating_ = do_interpolating;
 	do_discontinuity_adjustment_ = do_discontinuity_adjustment;
+	lazy_right_ = lazy_right_disparity;
+}
+
+bool MultiStepRefiner::SetBackend(const ADCensusBackend& backend)
+{
+	backend_ = backend;
+	return refine_kernels_.Has(backend);
 }
 
 void MultiStepRefiner::Refine()
 {
 	if (width_ <= 0 || height_ <= 0 ||
 		disp_left_ == nullptr || disp_right_ == nullptr ||
-		cost_ == nullptr || cross_arms_ == nullptr) {
+		cost_ == nullptr || cross_arms_ == nullptr || labels_ == nullptr || ray_map_ == nullptr) {
 		return;
 	}
 
+	(this->*refine_kernels_.Get(backend_))();
+}
+
+void MultiStepRefiner::RefineReference()
+{
+	RefineSteps(Backend_Reference);
+
+	// median filter
+	ADCENSUS_TRACE_SCOPE("MedianFilter");
+	adcensus_util::MedianFilter(MedianSource(), disp_left_, width_, height_, 3);
+}
+
+void MultiStepRefiner::RefineOptimized()
+{
+	RefineSteps(Backend_Optimized);
+
+	// median filter
+	ADCENSUS_TRACE_SCOPE("MedianFilter");
+	adcensus_util::GetKernels().median(MedianSource(), disp_left_, width_, height_, 3);
+}
+
+const float32* MultiStepRefiner::MedianSource()
+{
+	// ͼӲͼһԼʹãΪ˲ǰӲͼĸʹصĴھȡ˲ǰֵо͵˲
+	memcpy(disp_right_, disp_left_, width_ * height_ * sizeof(float32));
+	return disp_right_;
+}
+
+void MultiStepRefiner::RefineSteps(const ADCensusBackend& backend)
+{
+	num_occlusions_ = num_mismatches_ = num_filled_ = num_right_evaluated_ = 0;
+
 	// step1: outlier detection
 	if (do_lr_check_) {
 		OutlierDetection();
+		num_occlusions_ = static_cast<sint32>(occlusions_.size());
+		num_mismatches_ = static_cast<sint32>(mismatches_.size());
 	}
 	// step2: iterative region voting
 	if (do_region_voting_) {
-		IterativeRegionVoting();
+		const auto num_invalid = occlusions_.size() + mismatches_.size();
+		if (backend == Backend_Optimized) {
+			IterativeRegionVotingFast();
+		}
+		else {
+			IterativeRegionVoting();
+		}
+		num_filled_ += static_cast<sint32>(num_invalid - occlusions_.size() - mismatches_.size());
 	}
 	// step3: proper interpolation
 	if (do_interpolating_) {
-		ProperInterpolation();
+		if (backend == Backend_Optimized) {
+			ProperInterpolationFast();
+		}
+		else {
+			ProperInterpolation();
+		}
 	}
 	// step4: discontinuities adjustment
 	if (do_discontinuity_adjustment_) {
-		DepthDiscontinuityAdjustment();
+		if (backend == Backend_Optimized) {
+			DepthDiscontinuityAdjustmentFast();
+		}
+		else {
+			DepthDiscontinuityAdjustment();
+		}
 	}
-
-	// median filter
-	adcensus_util::MedianFilter(disp_left_, disp_left_, width_, height_, 3);
 }
 
 
 void MultiStepRefiner::OutlierDetection()
 {
+	ADCENSUS_TRACE_SCOPE("OutlierDetection");
 	const sint32 width = width_;
 	const sint32 height = height_;
 
@@ -101,57 +228,92 @@ void MultiStepRefiner::OutlierDetection()
 	mismatches.clear();
 
 	// ---һԼ
-	for (sint32 y = 0; y < height; y++) {
-		for (sint32 x = 0; x < width; x++) {
-			// ӰӲֵ
-			auto& disp = disp_left_[y * width + x];
-			if (disp == Invalid_Float) {
-				mismatches.emplace_back(x, y);
-				continue;
+	// ֻдеӲвУ״̬ȼͼٰռؼ˳߳޹
+	// ͼӲʱֻ㱾бʵУdisp_right_ͬһڲظ
+	const auto labels = labels_;
+	const sint32 disp_range = max_disparity_ - min_disparity_;
+	sint32 num_right_evaluated = 0;
+#pragma omp parallel reduction(+:num_right_evaluated)
+	{
+		vector<uint8> right_evaluated(lazy_right_ ? width : 0);
+		vector<float32> cost_local(lazy_right_ ? disp_range : 0);
+#pragma omp for schedule(static)
+		for (sint32 y = 0; y < height; y++) {
+			if (lazy_right_) {
+				memset(&right_evaluated[0], 0, width * sizeof(uint8));
 			}
+			for (sint32 x = 0; x < width; x++) {
+				// ӰӲֵ
+				auto& disp = disp_left_[y * width + x];
+				auto& label = labels[y * width + x];
+				label = Label_Valid;
+				if (disp == Invalid_Float) {
+					label = Label_Mismatch;
+					continue;
+				}
 
-			// ӲֵҵӰ϶Ӧͬ
-			const auto col_right = lround(x - disp);
-			if (col_right >= 0 && col_right < width) {
-				// ӰͬصӲֵ
-				const auto& disp_r = disp_right_[y * width + col_right];
-				// жӲֵǷһ£ֵֵڣ
-				if (abs(disp - disp_r) > threshold) {
-					// ڵƥ
-					// ͨӰӲӰƥأȡӲdisp_rl
-					// if(disp_rl > disp) 
-					//		pixel in occlusions
-					// else 
-					//		pixel in mismatches
-					const sint32 col_rl = lround(col_right + disp_r);
-					if (col_rl > 0 && col_rl < width) {
-						const auto& disp_l = disp_left_[y * width + col_rl];
-						if (disp_l > disp) {
-							occlusions.emplace_back(x, y);
+				// ӲֵҵӰ϶Ӧͬ
+				const auto col_right = lround(x - disp);
+				if (col_right >= 0 && col_right < width) {
+					// ӰͬصӲֵ
+					auto& disp_r = disp_right_[y * width + col_right];
+					if (lazy_right_ && !right_evaluated[col_right]) {
+						disp_r = adcensus_util::ComputeRightDisparity(cost_, width, min_disparity_, max_disparity_, y, col_right, &cost_local[0]);
+						right_evaluated[col_right] = 1;
+						num_right_evaluated++;
+					}
+					// жӲֵǷһ£ֵֵڣ
+					if (abs(disp - disp_r) > threshold) {
+						// ڵƥ
+						// ͨӰӲӰƥأȡӲdisp_rl
+						// if(disp_rl > disp) 
+						//		pixel in occlusions
+						// else 
+						//		pixel in mismatches
+						const sint32 col_rl = lround(col_right + disp_r);
+						if (col_rl > 0 && col_rl < width) {
+							const auto& disp_l = disp_left_[y * width + col_rl];
+							if (disp_l > disp) {
+								label = Label_Occlusion;
+							}
+							else {
+								label = Label_Mismatch;
+							}
 						}
 						else {
-							mismatches.emplace_back(x, y);
+							label = Label_Mismatch;
 						}
-					}
-					else {
-						mismatches.emplace_back(x, y);
-					}
 
-					// ӲֵЧ
+						// ӲֵЧ
+						disp = Invalid_Float;
+					}
+				}
+				else {
+					// ͨӲֵӰҲͬأӰΧ
 					disp = Invalid_Float;
+					label = Label_Mismatch;
 				}
 			}
-			else {
-				// ͨӲֵӰҲͬأӰΧ
-				disp = Invalid_Float;
+		}
+	}
+	num_right_evaluated_ = num_right_evaluated;
+
+	for (sint32 y = 0; y < height; y++) {
+		for (sint32 x = 0; x < width; x++) {
+			const auto& label = labels[y * width + x];
+			if (label == Label_Mismatch) {
 				mismatches.emplace_back(x, y);
 			}
+			else if (label == Label_Occlusion) {
+				occlusions.emplace_back(x, y);
+			}
 		}
 	}
 }
 
 void MultiStepRefiner::IterativeRegionVoting()
 {
+	ADCENSUS_TRACE_SCOPE("IterativeRegionVoting");
 	const sint32 width = width_;
 
 	const auto disp_range = max_disparity_ - min_disparity_;
@@ -169,11 +331,13 @@ void MultiStepRefiner::IterativeRegionVoting()
 	for (sint32 it = 0; it < num_iters; it++) {
 		for (sint32 k = 0; k < 2; k++) {
 			auto& trg_pixels = (k == 0) ? mismatches_ : occlusions_;
-			for (auto& pix : trg_pixels) {
-				const sint32& x = pix.first;
-				const sint32& y = pix.second;
-				auto& disp = disp_left_[y * width + x];
-				if(disp != Invalid_Float) {
+			// һαеͶƱڱǰӲͼͳһ䣨ش˳޹أڲУ
+			vector<float32> fill_disps(trg_pixels.size(), Invalid_Float);
+			for (auto n = 0u; n < trg_pixels.size(); n++) {
+				const sint32& x = trg_pixels[n].first;
+				const sint32& y = trg_pixels[n].second;
+				auto& disp = fill_disps[n];
+				if(disp_left_[y * width + x] != Invalid_Float) {
 					continue;
 				}
 
@@ -213,6 +377,11 @@ void MultiStepRefiner::IterativeRegionVoting()
 					}
 				}
 			}
+			for (auto n = 0u; n < trg_pixels.size(); n++) {
+				if (fill_disps[n] != Invalid_Float) {
+					disp_left_[trg_pixels[n].second * width + trg_pixels[n].first] = fill_disps[n];
+				}
+			}
 			// ɾ
 			for (auto it = trg_pixels.begin(); it != trg_pixels.end();) {
 				const sint32 x = it->first;
@@ -226,60 +395,216 @@ void MultiStepRefiner::IterativeRegionVoting()
 	}
 }
 
-void MultiStepRefiner::ProperInterpolation()
+void MultiStepRefiner::IterativeRegionVotingFast()
 {
+	ADCENSUS_TRACE_SCOPE("IterativeRegionVoting");
 	const sint32 width = width_;
 	const sint32 height = height_;
 
-	const float32 pi = 3.1415926f;
+	const auto disp_range = max_disparity_ - min_disparity_;
+	if (disp_range <= 0) {
+		return;
+	}
+	const auto arms = cross_arms_;
+	const auto labels = labels_;
+
+	// ͼЧؼ¼ȡӲţͶƱʱֱۼӣȡ
+#pragma omp parallel for schedule(static)
+	for (sint32 i = 0; i < width * height; i++) {
+		const auto& d = disp_left_[i];
+		labels[i] = (d != Invalid_Float) ? static_cast<sint16>(lround(d) - min_disparity_) : Label_Mismatch;
+	}
+	for (auto& pix : occlusions_) {
+		labels[pix.second * width + pix.first] = Label_Occlusion;
+	}
+
+	// صԭ˳ƥڵ԰򣩴
+	vector<sint32> targets[2];
+	for (sint32 k = 0; k < 2; k++) {
+		const auto& trg_pixels = (k == 0) ? mismatches_ : occlusions_;
+		targets[k].reserve(trg_pixels.size());
+		for (auto& pix : trg_pixels) {
+			targets[k].push_back(pix.second * width + pix.first);
+		}
+	}
+
+	// صͶƱֵʾ
+	vector<sint16> votes;
+
+	// 5
+	const sint32 num_iters = 5;
+
+	for (sint32 it = 0; it < num_iters; it++) {
+		sint32 num_filled = 0;
+		for (sint32 k = 0; k < 2; k++) {
+			auto& trg = targets[k];
+			const sint32 num_trg = static_cast<sint32>(trg.size());
+			votes.resize(num_trg);
+
+			// ͶƱֻͼزУͳһ
+#pragma omp parallel
+			{
+				// ̵ֱ߳ͼֻõӲ
+				vector<sint32> histogram(disp_range, 0);
+				vector<sint32> used_bins;
+				used_bins.reserve(disp_range);
+#pragma omp for schedule(dynamic, 64)
+				for (sint32 n = 0; n < num_trg; n++) {
+					const sint32 idx = trg[n];
+					const sint32 y = idx / width;
+					const sint32 x = idx - y * width;
+
+					// ֧Ӳֱͼۼʱͬ·ֵͬʱȡСӲӲҷֵĽͬ
+					sint32 best_disp = 0, count = 0;
+					sint32 max_ht = 0;
+					auto& arm = arms[idx];
+					for (sint32 t = -arm.top; t <= arm.bottom; t++) {
+						const sint32 yt = y + t;
+						auto& arm2 = arms[yt * width + x];
+						const sint16* label_row = labels + yt * width + x;
+						for (sint32 s = -arm2.left; s <= arm2.right; s++) {
+							const sint32 di = label_row[s];
+							if (di < 0) {
+								continue;
+							}
+							const sint32 h = ++histogram[di];
+							if (h == 1) {
+								used_bins.push_back(di);
+							}
+							if (h > max_ht || (h == max_ht && di < best_disp)) {
+								max_ht = h;
+								best_disp = di;
+							}
+							count++;
+						}
+					}
+					for (auto& di : used_bins) {
+						histogram[di] = 0;
+					}
+					used_bins.clear();
+
+					const bool fill = max_ht > 0 && count > irv_ts_ && max_ht * 1.0f / count > irv_th_;
+					votes[n] = fill ? static_cast<sint16>(best_disp) : Label_Mismatch;
+				}
+			}
+
+			// 䲢δأԭ˳
+			sint32 num_left = 0;
+			for (sint32 n = 0; n < num_trg; n++) {
+				const sint32 idx = trg[n];
+				if (votes[n] >= 0) {
+					disp_left_[idx] = static_cast<float32>(votes[n] + min_disparity_);
+					labels[idx] = votes[n];
+					num_filled++;
+				}
+				else {
+					trg[num_left++] = idx;
+				}
+			}
+			trg.resize(num_left);
+		}
+
+		// εδκأ֮ĵ
+		if (num_filled == 0) {
+			break;
+		}
+	}
+
+	// ɾأԭ˳
+	for (sint32 k = 0; k < 2; k++) {
+		auto& trg_pixels = (k == 0) ? mismatches_ : occlusions_;
+		size_t num_left = 0;
+		for (auto& pix : trg_pixels) {
+			if (disp_left_[pix.second * width + pix.first] == Invalid_Float) {
+				trg_pixels[num_left++] = pix;
+			}
+		}
+		trg_pixels.resize(num_left);
+	}
+}
+
+void MultiStepRefiner::ProperInterpolation()
+{
+	ADCENSUS_TRACE_SCOPE("ProperInterpolation");
 	// г̣ûбҪԶ
 	const sint32 max_search_length = std::max(abs(max_disparity_), abs(min_disparity_));
 
-	std::vector<pair<sint32, float32>> disp_collects;
+	for (sint32 k = 0; k < 2; k++) {
+		InterpolateByWalk((k == 0) ? mismatches_ : occlusions_, k == 1, max_search_length);
+	}
+}
+
+void MultiStepRefiner::ProperInterpolationFast()
+{
+	ADCENSUS_TRACE_SCOPE("ProperInterpolation");
+	// г̣ûбҪԶ
+	const sint32 max_search_length = std::max(abs(max_disparity_), abs(min_disparity_));
+
+	// ĲΧЧĴСȣƬЧڸظ߹ͬ·
+	// ЧϵĵÿÿЧֻһΣɨӲͼռЧءƵĲѡȡϿߣ߽ͬ
 	for (sint32 k = 0; k < 2; k++) {
 		auto& trg_pixels = (k == 0) ? mismatches_ : occlusions_;
 		if (trg_pixels.empty()) {
 			continue;
 		}
-		std::vector<float32> fill_disps(trg_pixels.size());
+		const float64 map_cost = Map_Scan_Cost * width_ * height_ + Map_Step_Cost * num_rays * trg_pixels.size();
+		const bool use_walk = float64(trg_pixels.size()) * num_rays * max_search_length < map_cost ||
+							  EstimateWalkSteps(trg_pixels, max_search_length) < map_cost;
+		if (use_walk) {
+			InterpolateByWalk(trg_pixels, k == 1, max_search_length);
+		}
+		else {
+			InterpolateByRayMap(trg_pixels, k == 1, max_search_length);
+		}
+	}
+}
 
-		// 
-		for (auto n = 0u; n < trg_pixels.size(); n++) {
+void MultiStepRefiner::InterpolateByWalk(vector<pair<int, int>>& trg_pixels, const bool& is_occlusion, const sint32& max_search_length)
+{
+	const sint32 width = width_;
+	if (trg_pixels.empty()) {
+		return;
+	}
+	std::vector<float32> fill_disps(trg_pixels.size());
+	const sint32 num_trg = static_cast<sint32>(trg_pixels.size());
+	sint32 num_filled = 0;
+
+	// أֻӲͼͳһ䣬ز
+#pragma omp parallel
+	{
+		std::vector<pair<sint32, float32>> disp_collects;
+#pragma omp for schedule(dynamic, 64) reduction(+:num_filled)
+		for (sint32 n = 0; n < num_trg; n++) {
 			auto& pix = trg_pixels[n];
 			const sint32 x = pix.first;
 			const sint32 y = pix.second;
 
 			// ռ16׸ЧӲֵ
 			disp_collects.clear();
-			double ang = 0.0;
-			for (sint32 s = 0; s < 16; s++) {
-				const auto sina = sin(ang);
-				const auto cosa = cos(ang);
+			for (sint32 s = 0; s < num_rays; s++) {
+				sint32 xx = x, yy = y;
 				for (sint32 m = 1; m < max_search_length; m++) {
-					const sint32 yy = lround(y + m * sina);
-					const sint32 xx = lround(x + m * cosa);
-					if (yy < 0 || yy >= height || xx < 0 || xx >= width) { break;}
+					if (!NextOnRay(rays_[s], xx, yy)) { break; }
 					const auto& d = disp_left_[yy * width + xx];
 					if (d != Invalid_Float) {
-						disp_collects.emplace_back(yy * width * 3 + 3 * xx, d);
+						disp_collects.emplace_back(yy * img_left_.stride + xx * img_left_.pixel_step, d);
 						break;
 					}
 				}
-				ang += pi / 16;
 			}
 			if (disp_collects.empty()) {
 				continue;
 			}
+			num_filled++;
 
 			// ƥѡɫӲֵ
 			// ڵѡСӲֵ
-			if (k == 0) {
+			if (!is_occlusion) {
 				sint32 min_dist = 9999;
 				float32 d = 0.0f;
-				const auto color = ADColor(img_left_[y*width * 3 + 3 * x], img_left_[y*width * 3 + 3 * x + 1], img_left_[y*width * 3 + 3 * x + 2]);
+				const auto pixel = img_left_.pixel(x, y);
 				for (auto& dc : disp_collects) {
-					const auto color2 = ADColor(img_left_[dc.first], img_left_[dc.first + 1], img_left_[dc.first + 2]);
-					const auto dist = abs(color.r - color2.r) + abs(color.g - color2.g) + abs(color.b - color2.b);
+					const auto dist = img_left_.sum_diff(pixel, img_left_.data + dc.first);
 					if (min_dist > dist) {
 						min_dist = dist;
 						d = dc.second;
@@ -295,17 +620,159 @@ void MultiStepRefiner::ProperInterpolation()
 				fill_disps[n] = min_disp;
 			}
 		}
-		for (auto n = 0u; n < trg_pixels.size(); n++) {
-			auto& pix = trg_pixels[n];
-			const sint32 x = pix.first;
-			const sint32 y = pix.second;
-			disp_left_[y * width + x] = fill_disps[n];
+	}
+	num_filled_ += num_filled;
+	for (auto n = 0u; n < trg_pixels.size(); n++) {
+		auto& pix = trg_pixels[n];
+		const sint32 x = pix.first;
+		const sint32 y = pix.second;
+		disp_left_[y * width + x] = fill_disps[n];
+	}
+}
+
+void MultiStepRefiner::InterpolateByRayMap(vector<pair<int, int>>& trg_pixels, const bool& is_occlusion, const sint32& max_search_length)
+{
+	const sint32 width = width_;
+	const sint32 height = height_;
+	const auto ray_map = ray_map_;
+	const sint32 num_trg = static_cast<sint32>(trg_pixels.size());
+
+	// ֻЧϽУΪЧأΪ
+	for (sint32 n = 0; n < num_trg; n++) {
+		if (disp_left_[trg_pixels[n].second * width + trg_pixels[n].first] != Invalid_Float) {
+			InterpolateByWalk(trg_pixels, is_occlusion, max_search_length);
+			return;
+		}
+	}
+
+	// ˳ռЧأray_map¼Чص
+	// ׸Ч֮ǰΪЧأĳصĽֻȡأЧΪ̣ú̵Ľ
+	std::vector<sint32> invalid_x;
+	std::vector<sint32> row_begin(height + 1);
+	for (sint32 y = 0; y < height; y++) {
+		row_begin[y] = static_cast<sint32>(invalid_x.size());
+		const float32* disp_row = disp_left_ + y * width;
+		for (sint32 x = 0; x < width; x++) {
+			if (disp_row[x] == Invalid_Float) {
+				ray_map[y * width + x] = static_cast<sint32>(invalid_x.size());
+				invalid_x.push_back(x);
+			}
 		}
 	}
+	row_begin[height] = static_cast<sint32>(invalid_x.size());
+	const sint32 num_invalid = row_begin[height];
+	std::vector<sint32> trg_index(num_trg);
+	for (sint32 n = 0; n < num_trg; n++) {
+		trg_index[n] = ray_map[trg_pixels[n].second * width + trg_pixels[n].first];
+	}
+
+	// صǰĺѡƥΪɫߣɫͬʱȵķȣڵΪСӲ
+	std::vector<float32> fill_disps(num_trg, is_occlusion ? Large_Float : 0.0f);
+	std::vector<sint32> min_dists(num_trg, 9999);
+	std::vector<uint8> found(num_trg, 0);
+
+	// еƣ˳ºѡռѡȡĽͬ
+#pragma omp parallel
+	{
+		// ЧߣгСmax_search_length׸ЧأӰƫƣΪ-1Ӳг
+		std::vector<sint32> nearest(num_invalid);
+		std::vector<float32> nearest_disps(num_invalid);
+		std::vector<sint32> lengths(num_invalid);
+#pragma omp for ordered schedule(static, 1)
+		for (sint32 s = 0; s < num_rays; s++) {
+			const auto& ray = rays_[s];
+			// ڵǰؼ㣺yΪʱ᷽УxΪʱ᷽У᷽
+			const bool rows_reversed = ray.x_major ? (ray.step_minor > 0) : (ray.step_major > 0);
+			const bool cols_reversed = ray.x_major && ray.step_major > 0;
+			for (sint32 r = 0; r < height; r++) {
+				const sint32 y = rows_reversed ? height - 1 - r : r;
+				const sint32 begin = row_begin[y];
+				const sint32 end = row_begin[y + 1];
+				for (sint32 c = begin; c < end; c++) {
+					const sint32 k = cols_reversed ? begin + end - 1 - c : c;
+					sint32 xx = invalid_x[k], yy = y;
+					if (!NextOnRay(ray, xx, yy)) {
+						nearest[k] = -1;
+						nearest_disps[k] = Invalid_Float;
+						lengths[k] = 0;
+						continue;
+					}
+					const sint32 idx = yy * width + xx;
+					const float32 d = disp_left_[idx];
+					if (d != Invalid_Float) {
+						nearest[k] = (1 < max_search_length) ? yy * img_left_.stride + xx * img_left_.pixel_step : -1;
+						nearest_disps[k] = d;
+						lengths[k] = 1;
+					}
+					else {
+						const sint32 next = ray_map[idx];
+						const sint32 length = lengths[next] + 1;
+						nearest[k] = (length < max_search_length) ? nearest[next] : -1;
+						nearest_disps[k] = nearest_disps[next];
+						lengths[k] = length;
+					}
+				}
+			}
+
+#pragma omp ordered
+			{
+				for (sint32 n = 0; n < num_trg; n++) {
+					const sint32 k = trg_index[n];
+					if (nearest[k] < 0) {
+						continue;
+					}
+					const float32 d = nearest_disps[k];
+					found[n] = 1;
+					if (!is_occlusion) {
+						const auto dist = img_left_.sum_diff(img_left_.pixel(trg_pixels[n].first, trg_pixels[n].second), img_left_.data + nearest[k]);
+						if (min_dists[n] > dist) {
+							min_dists[n] = dist;
+							fill_disps[n] = d;
+						}
+					}
+					else {
+						fill_disps[n] = std::min(fill_disps[n], d);
+					}
+				}
+			}
+		}
+	}
+
+	// δҵЧʱͬProperInterpolationΪ0
+	for (sint32 n = 0; n < num_trg; n++) {
+		auto& pix = trg_pixels[n];
+		if (found[n]) {
+			num_filled_++;
+		}
+		disp_left_[pix.second * width + pix.first] = found[n] ? fill_disps[n] : 0.0f;
+	}
+}
+
+float64 MultiStepRefiner::EstimateWalkSteps(const vector<pair<int, int>>& trg_pixels, const sint32& max_search_length) const
+{
+	// ȼȡWalk_Samplesأ16ͳƲ
+	const sint32 num_trg = static_cast<sint32>(trg_pixels.size());
+	const sint32 stride = std::max(num_trg / Walk_Samples, 1);
+	sint64 steps = 0;
+	sint32 num_samples = 0;
+	for (sint32 n = 0; n < num_trg; n += stride) {
+		for (sint32 s = 0; s < num_rays; s++) {
+			sint32 xx = trg_pixels[n].first, yy = trg_pixels[n].second;
+			for (sint32 m = 1; m < max_search_length; m++) {
+				steps++;
+				if (!NextOnRay(rays_[s], xx, yy) || disp_left_[yy * width_ + xx] != Invalid_Float) {
+					break;
+				}
+			}
+		}
+		num_samples++;
+	}
+	return num_samples > 0 ? float64(steps) * num_trg / num_samples : 0.0;
 }
 
 void MultiStepRefiner::DepthDiscontinuityAdjustment()
 {
+	ADCENSUS_TRACE_SCOPE("DepthDiscontinuityAdjustment");
 	const sint32 width = width_;
 	const sint32 height = height_;
 	const auto disp_range = max_disparity_ - min_disparity_;
@@ -315,46 +782,108 @@ void MultiStepRefiner::DepthDiscontinuityAdjustment()
 	
 	// ӲͼԵ
 	// Եķģѡsobel
+	// ͼھֲͶƱʹãڴűԵ
 	const float32 edge_thres = 5.0f;
-	EdgeDetect(&vec_edge_left_[0], disp_left_, width, height, edge_thres);
+	const auto edge_left = reinterpret_cast<uint8*>(labels_);
+	EdgeDetect(edge_left, disp_left_, width, height, edge_thres);
 
-	// ԵصӲ
+	// ԵصӲֻдеӲв
+#pragma omp parallel for schedule(static)
 	for (sint32 y = 0; y < height; y++) {
-		for (sint32 x = 1; x < width - 1; x++) {
-			const auto& e_label = vec_edge_left_[y*width + x];
-			if (e_label == 1) {
-				const auto disp_ptr = disp_left_ + y*width;
-				float32& d = disp_ptr[x];
-				if (d != Invalid_Float) {
-					const sint32& di = lround(d);
-					const auto cost_ptr = cost_ + y*width*disp_range + x*disp_range;
-					float32 c0 = cost_ptr[di];
-
-					// ¼صӲֵʹֵ
-					// ѡСӲֵ
-					for (int k = 0; k<2; k++) {
-						const sint32 x2 = (k == 0) ? x - 1 : x + 1;
-						const float32& d2 = disp_ptr[x2];
-						const sint32& d2i = lround(d2);
-						if (d2 != Invalid_Float) {
-							const auto& c = (k == 0) ? cost_ptr[-disp_range + d2i] : cost_ptr[disp_range + d2i];
-							if (c < c0) {
-								d = d2;
-								c0 = c;
-							}
+		AdjustDiscontinuityRow(y, edge_left + y * width);
+	}
+}
+
+void MultiStepRefiner::DepthDiscontinuityAdjustmentFast()
+{
+	ADCENSUS_TRACE_SCOPE("DepthDiscontinuityAdjustment");
+	const sint32 width = width_;
+	const sint32 height = height_;
+	const auto disp_range = max_disparity_ - min_disparity_;
+	if (disp_range <= 0 || width < 3 || height < 3) {
+		return;
+	}
+
+	const float32 edge_thres = 5.0f;
+	const auto& kernels = adcensus_util::GetKernels();
+
+	// ԵֻڲУڲа̷߳Ϊдд϶ʽ
+	// ȼ㱾еıԵڵǰһУʱ丱ٵ
+#pragma omp parallel
+	{
+		sint32 num_threads = 1, thread = 0;
+#ifdef _OPENMP
+		num_threads = omp_get_num_threads();
+		thread = omp_get_thread_num();
+#endif
+		const sint32 num_rows = height - 2;
+		const sint32 y_begin = 1 + num_rows * thread / num_threads;
+		const sint32 y_end = 1 + num_rows * (thread + 1) / num_threads;
+
+		std::vector<float32> row_copies(3 * width);
+		std::vector<uint8> edge(width);
+		float32* row_last = &row_copies[0];
+		float32* row_saved = &row_copies[width];
+		float32* row_below_band = &row_copies[2 * width];
+
+		// дϷ·д߳̿ʼǰ
+		if (y_begin < y_end) {
+			memcpy(row_last, disp_left_ + (y_begin - 1) * width, width * sizeof(float32));
+			memcpy(row_below_band, disp_left_ + y_end * width, width * sizeof(float32));
+		}
+#pragma omp barrier
+
+		for (sint32 y = y_begin; y < y_end; y++) {
+			float32* row = disp_left_ + y * width;
+			const float32* row_below = (y + 1 == y_end) ? row_below_band : row + width;
+			kernels.sobel_edge(row_last, row, row_below, width, edge_thres, &edge[0]);
+
+			// еǰֵΪһеһ
+			memcpy(row_saved, row, width * sizeof(float32));
+			AdjustDiscontinuityRow(y, &edge[0]);
+			std::swap(row_last, row_saved);
+		}
+	}
+}
+
+void MultiStepRefiner::AdjustDiscontinuityRow(const sint32& y, const uint8* edge)
+{
+	const sint32 width = width_;
+	const auto disp_range = max_disparity_ - min_disparity_;
+	for (sint32 x = 1; x < width - 1; x++) {
+		const auto& e_label = edge[x];
+		if (e_label == 1) {
+			const auto disp_ptr = disp_left_ + y*width;
+			float32& d = disp_ptr[x];
+			if (d != Invalid_Float) {
+				const sint32& di = lround(d);
+				const auto cost_ptr = cost_ + y*width*disp_range + x*disp_range;
+				float32 c0 = cost_ptr[di];
+
+				// ¼صӲֵʹֵ
+				// ѡСӲֵ
+				for (int k = 0; k<2; k++) {
+					const sint32 x2 = (k == 0) ? x - 1 : x + 1;
+					const float32& d2 = disp_ptr[x2];
+					const sint32& d2i = lround(d2);
+					if (d2 != Invalid_Float) {
+						const auto& c = (k == 0) ? cost_ptr[-disp_range + d2i] : cost_ptr[disp_range + d2i];
+						if (c < c0) {
+							d = d2;
+							c0 = c;
 						}
 					}
 				}
 			}
 		}
 	}
-	
 }
 
 void MultiStepRefiner::EdgeDetect(uint8* edge_mask, const float32* disp_ptr, const sint32& width, const sint32& height, const float32 threshold)
 {
 	memset(edge_mask, 0, width*height * sizeof(uint8));
 	// sobel
+#pragma omp parallel for schedule(static)
 	for (int y = 1; y < height - 1; y++) {
 		for (int x = 1; x < width - 1; x++) {
 			const auto grad_x = (-disp_ptr[(y - 1) * width + x - 1] + disp_ptr[(y - 1) * width + x + 1]) +
@@ -362,7 +891,7 @@ void MultiStepRefiner::EdgeDetect(uint8* edge_mask, const float32* disp_ptr, con
 				(-disp_ptr[(y + 1) * width + x - 1] + disp_ptr[(y + 1) * width + x + 1]);
 			const auto grad_y = (-disp_ptr[(y - 1) * width + x - 1] - 2 * disp_ptr[(y - 1) * width + x] - disp_ptr[(y - 1) * width + x + 1]) +
 				(disp_ptr[(y + 1) * width + x - 1] + 2 * disp_ptr[(y + 1) * width + x] + disp_ptr[(y + 1) * width + x + 1]);
-			const auto grad = abs(grad_x) + abs(grad_y);
+			const auto grad = std::fabs(grad_x) + std::fabs(grad_y);
 			if (grad > threshold) {
 				edge_mask[y*width + x] = 1;
 			}
@@ -9,6 +9,7 @@
 
 #include "adcensus_types.h"
 #include "cross_aggregator.h"
+#include "stage_kernels.h"
 
 class MultiStepRefiner
 {
@@ -24,15 +25,22 @@ public:
 	 */
 	bool Initialize(const sint32& width, const sint32& height);
 
+	/**
+	 * \brief öಽŻĻ棬ڴⲿڴͳһ
+	 * \param labels		// ͼ״̬ͼwidth*height
+	 * \param ray_map		// ڲЧͼwidth*height
+	 */
+	void SetBuffers(sint16* labels, sint32* ray_map);
+
 	/**
 	 * \brief öಽŻ
-	 * \param img_left			// Ӱݣͨ
+	 * \param img_left			// Ӱͼ
 	 * \param cost				// 
 	 * \param cross_arms		// ʮֽ
 	 * \param disp_left			// ͼӲ
 	 * \param disp_right		// ͼӲ
 	 */
-	void SetData(const uint8* img_left, float32* cost,const CrossArm* cross_arms, float32* disp_left, float32* disp_right);
+	void SetData(const ADImageView& img_left, float32* cost,const CrossArm* cross_arms, float32* disp_left, float32* disp_right);
 
 
 	/**
@@ -46,23 +54,80 @@ public:
 	 * \param do_region_voting				// Ƿڲ
 	 * \param do_interpolating				// ǷֲͶƱ
 	 * \param do_discontinuity_adjustment	// Ƿ
+	 * \param lazy_right_disparity			// ǷһԼʱͼӲ
 	 */
 	void SetParam(const sint32& min_disparity, const sint32& max_disparity, const sint32& irv_ts, const float32& irv_th, const float32& lrcheck_thres,
-				  const bool&	do_lr_check, const bool& do_region_voting, const bool& do_interpolating, const bool& do_discontinuity_adjustment);
+				  const bool&	do_lr_check, const bool& do_region_voting, const bool& do_interpolating, const bool& do_discontinuity_adjustment,
+				  const bool& lazy_right_disparity);
+
+	/**
+	 * \brief ü
+	 * \param backend		// 
+	 * \return true: úעʵ֣false: δעᣬ˻زοʵ
+	 */
+	bool SetBackend(const ADCensusBackend& backend);
 
 	/** \brief ಽӲŻ */
 	void Refine();
 
+	/** \brief ȡһŻڵ */
+	sint32 get_num_occlusions() const { return num_occlusions_; }
+	/** \brief ȡһŻƥ */
+	sint32 get_num_mismatches() const { return num_mismatches_; }
+	/** \brief ȡһŻб */
+	sint32 get_num_filled() const { return num_filled_; }
+	/** \brief ȡһŻаͼӲδʱΪ0 */
+	sint32 get_num_right_evaluated() const { return num_right_evaluated_; }
+
 private:
+	/** \brief ಽӲŻοʵ֣ */
+	void RefineReference();
+	/** \brief ಽӲŻŻʵֵ֣˲ʹõǰָں */
+	void RefineOptimized();
+	/** \brief ֵ˲ǰ4СӲŻbackendΪBackend_OptimizedʱֲͶƱʹŻʵ */
+	void RefineSteps(const ADCensusBackend& backend);
+	/** \brief ˲ǰӲͼͼӲͼʱѲʹãΪֵ˲ */
+	const float32* MedianSource();
+
 	//------4СӲŻ------//
 	/** \brief Ⱥ */
 	void OutlierDetection();
-	/** \brief ֲͶƱ */
+	/** \brief ֲͶƱÿαͶƱڱǰӲͼJacobiʽͳһ */
 	void IterativeRegionVoting();
-	/** \brief ڲ */
+	/** \brief ֲͶƱŻʵ֣״̬ͼȡֱͼֻõӲزУ
+	 *		   ĳεδκʱǰIterativeRegionVotingͬ߳޹ */
+	void IterativeRegionVotingFast();
+	/** \brief ڲ䣬16Ч */
 	void ProperInterpolation();
-	/** \brief ȷӲ */
+	/** \brief ڲ䣨Żʵ֣ƥڵ԰ƵĺʱѡЧϵĵƣProperInterpolationͬ */
+	void ProperInterpolationFast();
+	/** \brief 16һأƥڵгСmax_search_length */
+	void InterpolateByWalk(vector<pair<int, int>>& trg_pixels, const bool& is_occlusion, const sint32& max_search_length);
+	/** \brief Чϵĵһأÿ򰴺ȵ˳һȫЧأõڸ÷Чأ */
+	void InterpolateByRayMap(vector<pair<int, int>>& trg_pixels, const bool& is_occlusion, const sint32& max_search_length);
+	/** \brief һܲ */
+	float64 EstimateWalkSteps(const vector<pair<int, int>>& trg_pixels, const sint32& max_search_length) const;
+	/** \brief ȷӲȶӲͼԵ⣬еԵ */
 	void DepthDiscontinuityAdjustment();
+	/** \brief ȷӲŻʵ֣мsobelԵںˣ漴УԵͼDepthDiscontinuityAdjustmentͬ */
+	void DepthDiscontinuityAdjustmentFast();
+	/** \brief ԵǵyбԵصӲھ͵ص */
+	void AdjustDiscontinuityRow(const sint32& y, const uint8* edge);
+
+	/**
+	 * \brief ڲߣÿƶһأᰴصֱ߲
+	 * ÿһֻȡڵǰص޹أʺһصǰһߵĺ
+	 */
+	struct InterpolationRay {
+		bool x_major;				// ǷΪx
+		sint32 step_major;			// Ჽ򣬡1
+		sint32 step_minor;			// Ჽ01
+		vector<uint8> minor_steps;	// iһǷشƶ
+	};
+	/** \brief Ӱߴ繹16 */
+	void BuildRays();
+	/** \brief ǰһӰΧʱfalse */
+	bool NextOnRay(const InterpolationRay& ray, sint32& x, sint32& y) const;
 
 	/** \brief ӲͼԵ	 */
 	static void EdgeDetect(uint8* edge_mask, const float32* disp_ptr,const sint32& width,const sint32& height, const float32 threshold);
@@ -71,8 +136,8 @@ private:
 	sint32	width_;
 	sint32	height_;
 
-	/** \brief Ӱݣͨ */
-	const uint8* img_left_;
+	/** \brief Ӱͼ */
+	ADImageView img_left_;
 	
 	/** \brief  */
 	float32* cost_;
@@ -84,8 +149,12 @@ private:
 	/** \brief ͼӲ */
 	float* disp_right_;
 
-	/** \brief ͼԵ */
-	vector<uint8> vec_edge_left_;
+	/** \brief ͼ״̬ͼЧΪȡӲСӲţЧΪֵƥڵ */
+	sint16* labels_;
+	/** \brief ڲʱЧڰռЧеţЧش */
+	sint32* ray_map_;
+	/** \brief ڲ16 */
+	InterpolationRay rays_[16];
 	
 	/** \brief СӲֵ */
 	sint32 min_disparity_;
@@ -108,10 +177,26 @@ private:
 	bool	do_interpolating_;
 	/** \brief Ƿ */
 	bool	do_discontinuity_adjustment_;
+	/** \brief ǷһԼʱͼӲʱdisp_right_ڼǰЧ */
+	bool	lazy_right_;
 	
 	/** \brief ڵؼ	*/
 	vector<pair<int, int>> occlusions_;
 	/** \brief ƥؼ	*/
 	vector<pair<int, int>> mismatches_;
+
+	/** \brief ڵ */
+	sint32 num_occlusions_;
+	/** \brief ƥ */
+	sint32 num_mismatches_;
+	/** \brief  */
+	sint32 num_filled_;
+	/** \brief ͼӲ */
+	sint32 num_right_evaluated_;
+
+	/** \brief  */
+	ADCensusBackend backend_;
+	/** \brief ಽŻĸʵ */
+	StageKernels<void (MultiStepRefiner::*)()> refine_kernels_;
 };
 #endif
@@ -0,0 +1,125 @@
+/* -*-c++-*- AD-Census - Copyright (C) 2020.
+* Author	: Yingsong Li(Ethan Li) <ethan.li.whu@gmail.com>
+* https://github.com/ethan-li-coding/AD-Census
+* Describe	: implement of class PerfCounters
+*/
+
+#include "perf_counters.h"
+#include <cstring>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/**
+ * \brief Ϊ̴߳һͳû̬
+ * \return ļʧܷ-1
+ */
+static sint32 OpenCounter(const uint32& type, const uint64& config)
+{
+	perf_event_attr attr;
+	memset(&attr, 0, sizeof(perf_event_attr));
+	attr.size = sizeof(perf_event_attr);
+	attr.type = type;
+	attr.config = config;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+	return static_cast<sint32>(syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+}
+#endif
+
+PerfCounters::PerfCounters(): is_opened_(false), is_available_(false) { }
+
+PerfCounters::~PerfCounters()
+{
+	Close();
+}
+
+bool PerfCounters::Open()
+{
+	if (is_opened_) {
+		return is_available_;
+	}
+	is_opened_ = true;
+	is_available_ = false;
+
+#ifdef __linux__
+	sint32 num_threads = 1;
+#ifdef _OPENMP
+	num_threads = omp_get_max_threads();
+#endif
+	for (sint32 c = 0; c < Counter_Count; c++) {
+		fds_[c].assign(num_threads, -1);
+	}
+
+	// ֻͳƴ̣߳ڲɸ̷ֱ߳
+	const uint64 dtlb_read_miss = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+								  (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+#pragma omp parallel num_threads(num_threads)
+	{
+		sint32 tid = 0;
+#ifdef _OPENMP
+		tid = omp_get_thread_num();
+#endif
+		fds_[Counter_Cycles][tid] = OpenCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+		fds_[Counter_Instructions][tid] = OpenCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+		fds_[Counter_LLCMisses][tid] = OpenCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+		fds_[Counter_DTLBMisses][tid] = OpenCounter(PERF_TYPE_HW_CACHE, dtlb_read_miss);
+	}
+
+	for (sint32 c = 0; c < Counter_Count; c++) {
+		for (auto& fd : fds_[c]) {
+			is_available_ = is_available_ || fd >= 0;
+		}
+	}
+#endif
+
+	return is_available_;
+}
+
+void PerfCounters::Close()
+{
+	for (sint32 c = 0; c < Counter_Count; c++) {
+#ifdef __linux__
+		for (auto& fd : fds_[c]) {
+			if (fd >= 0) {
+				close(fd);
+			}
+		}
+#endif
+		fds_[c].clear();
+	}
+	is_opened_ = false;
+	is_available_ = false;
+}
+
+void PerfCounters::Read(sint64 values[Counter_Count]) const
+{
+	for (sint32 c = 0; c < Counter_Count; c++) {
+		values[c] = -1;
+#ifdef __linux__
+		float64 sum = 0.0;
+		bool valid = false;
+		for (auto& fd : fds_[c]) {
+			if (fd < 0) {
+				continue;
+			}
+			// value, time_enabled, time_running
+			uint64 buf[3];
+			if (read(fd, buf, sizeof(buf)) != sizeof(buf)) {
+				continue;
+			}
+			// ʱʱ
+			sum += (buf[2] > 0 && buf[2] < buf[1]) ? static_cast<float64>(buf[0]) * buf[1] / buf[2] : static_cast<float64>(buf[0]);
+			valid = true;
+		}
+		if (valid) {
+			values[c] = static_cast<sint64>(sum);
+		}
+#endif
+	}
+}
@@ -0,0 +1,57 @@
+/* -*-c++-*- AD-Census - Copyright (C) 2020.
+* Author	: Yingsong Li(Ethan Li) <ethan.li.whu@gmail.com>
+* https://github.com/ethan-li-coding/AD-Census
+* Describe	: header of class PerfCounters
+*/
+
+#ifndef AD_CENSUS_PERF_COUNTERS_H_
+#define AD_CENSUS_PERF_COUNTERS_H_
+
+#include "adcensus_types.h"
+
+/**
+ * \brief ӲܼLinux perf_event
+ * Ϊÿ̷ֱ߳򿪼ȡʱԸ߳
+ * Linuxƽ̨Ȩޣperf_event_paranoidƣʱʧܣֵΪ-1
+ */
+class PerfCounters {
+public:
+	/** \brief  */
+	enum Counter {
+		Counter_Cycles = 0,			// CPU
+		Counter_Instructions,		// ָ
+		Counter_LLCMisses,			// ĩȱʧ
+		Counter_DTLBMisses,			// TLBȱʧ
+		Counter_Count
+	};
+
+	PerfCounters();
+	~PerfCounters();
+
+	/**
+	 * \brief Ϊǰ̵ĸ̴߳򿪼
+	 * \return true: һ
+	 */
+	bool Open();
+
+	/** \brief رռ */
+	void Close();
+
+	/** \brief Ƿпõļ */
+	bool is_available() const { return is_available_; }
+
+	/**
+	 * \brief ȡǰۼֵ֮߳ͣѰʱţ
+	 * \param values	ֵõļΪ-1
+	 */
+	void Read(sint64 values[Counter_Count]) const;
+
+private:
+	/** \brief ڸ߳ϵļ-1ʾʧ */
+	vector<sint32> fds_[Counter_Count];
+	/** \brief ǷѳԴ */
+	bool is_opened_;
+	/** \brief Ƿпõļ */
+	bool is_available_;
+};
+#endif
@@ -5,18 +5,25 @@
 */
 
 #include "scanline_optimizer.h"
+#include "adcensus_trace.h"
+#include "adcensus_util.h"
 
 #include <cassert>
 
-ScanlineOptimizer::ScanlineOptimizer(): width_(0), height_(0), img_left_(nullptr), img_right_(nullptr),
+ScanlineOptimizer::ScanlineOptimizer(): width_(0), height_(0),
+                                        diff_left_h_(nullptr), diff_left_v_(nullptr), diff_right_h_(nullptr), diff_right_v_(nullptr),
                                         cost_init_(nullptr), cost_aggr_(nullptr),
                                         min_disparity_(0), max_disparity_(0),
                                         so_p1_(0), so_p2_(0),
-                                        so_tso_(0) {}
+                                        so_tso_(0), backend_(Backend_Optimized)
+{
+	optimize_kernels_.Register(Backend_Optimized, &ScanlineOptimizer::OptimizeOptimized);
+	optimize_kernels_.Register(Backend_Reference, &ScanlineOptimizer::OptimizeReference);
+}
 
 ScanlineOptimizer::~ScanlineOptimizer() {}
 
-void ScanlineOptimizer::SetData(const uint8* img_left, const uint8* img_right, float32* cost_init,
+void ScanlineOptimizer::SetData(const ADImageView& img_left, const ADImageView& img_right, float32* cost_init,
 	float32* cost_aggr)
 {
 	img_left_ = img_left;
@@ -25,6 +32,15 @@ void ScanlineOptimizer::SetData(const uint8* img_left, const uint8* img_right, f
 	cost_aggr_ = cost_aggr;
 }
 
+void ScanlineOptimizer::SetColorDiffs(const uint8* diff_left_h, const uint8* diff_left_v, const uint8* diff_right_h,
+	const uint8* diff_right_v)
+{
+	diff_left_h_ = diff_left_h;
+	diff_left_v_ = diff_left_v;
+	diff_right_h_ = diff_right_h;
+	diff_right_v_ = diff_right_v;
+}
+
 void ScanlineOptimizer::SetParam(const sint32& width, const sint32& height, const sint32& min_disparity,
 	const sint32& max_disparity, const float32& p1, const float32& p2, const sint32& tso)
 {
@@ -37,14 +53,26 @@ void ScanlineOptimizer::SetParam(const sint32& width, const sint32& height, cons
 	so_tso_ = tso;
 }
 
+bool ScanlineOptimizer::SetBackend(const ADCensusBackend& backend)
+{
+	backend_ = backend;
+	return optimize_kernels_.Has(backend);
+}
+
 void ScanlineOptimizer::Optimize()
 {
 	if (width_ <= 0 || height_ <= 0 ||
-		img_left_ == nullptr || img_right_ == nullptr ||
-		cost_init_ == nullptr || cost_aggr_ == nullptr) {
+		img_left_.data == nullptr || img_right_.data == nullptr ||
+		cost_init_ == nullptr || cost_aggr_ == nullptr ||
+		diff_left_h_ == nullptr || diff_left_v_ == nullptr || diff_right_h_ == nullptr || diff_right_v_ == nullptr) {
 		return;
 	}
-	
+
+	(this->*optimize_kernels_.Get(backend_))();
+}
+
+void ScanlineOptimizer::OptimizeReference()
+{
 	// 4ɨŻ
 	// ģ״һ۾ۺϺݣҲcost_aggr_
 	// ǰĸŻУcost_init_cost_aggr_αʱݣÿٶڴ洢м
@@ -60,8 +88,18 @@ void ScanlineOptimizer::Optimize()
 	ScanlineOptimizeUpDown(cost_init_, cost_aggr_, false);
 }
 
+void ScanlineOptimizer::OptimizeOptimized()
+{
+	// Ĵοʵͬ
+	ScanlineLeftRightKernel(cost_aggr_, cost_init_, true);
+	ScanlineLeftRightKernel(cost_init_, cost_aggr_, false);
+	ScanlineUpDownKernel(cost_aggr_, cost_init_, true);
+	ScanlineUpDownKernel(cost_init_, cost_aggr_, false);
+}
+
 void ScanlineOptimizer::ScanlineOptimizeLeftRight(const float32* cost_so_src, float32* cost_so_dst, bool is_forward)
 {
+	ADCENSUS_TRACE_SCOPE(is_forward ? "ScanlineLeftToRight" : "ScanlineRightToLeft");
 	const auto width = width_;
 	const auto height = height_;
 	const auto min_disparity = min_disparity_;
@@ -84,12 +122,11 @@ void ScanlineOptimizer::ScanlineOptimizeLeftRight(const float32* cost_so_src, fl
 		// ·ͷΪÿһе(β,dir=-1)
 		auto cost_init_row = (is_forward) ? (cost_so_src + y * width * disp_range) : (cost_so_src + y * width * disp_range + (width - 1) * disp_range);
 		auto cost_aggr_row = (is_forward) ? (cost_so_dst + y * width * disp_range) : (cost_so_dst + y * width * disp_range + (width - 1) * disp_range);
-		auto img_row = (is_forward) ? (img_left_ + y * width * 3) : (img_left_ + y * width * 3 + 3 * (width - 1));
-		const auto img_row_r = img_right_ + y * width * 3;
+		auto img_row = (is_forward) ? img_left_.pixel(0, y) : img_left_.pixel(width - 1, y);
 		sint32 x = (is_forward) ? 0 : width - 1;
 
 		// ·ϵǰɫֵһɫֵ
-		ADColor color(img_row[0], img_row[1], img_row[2]);
+		ADColor color = img_left_.color(img_row);
 		ADColor color_last = color;
 
 		// ·ϸصĴ飬ԪΪ˱߽βһ
@@ -100,7 +137,7 @@ void ScanlineOptimizer::ScanlineOptimizeLeftRight(const float32* cost_so_src, fl
 		memcpy(&cost_last_path[1], cost_aggr_row, disp_range * sizeof(float32));
 		cost_init_row += direction * disp_range;
 		cost_aggr_row += direction * disp_range;
-		img_row += direction * 3;
+		img_row += direction * img_left_.pixel_step;
 		x += direction;
 
 		// ·ϸصСֵ
@@ -111,17 +148,15 @@ void ScanlineOptimizer::ScanlineOptimizeLeftRight(const float32* cost_so_src, fl
 
 		// Էϵ2ؿʼ˳ۺ
 		for (sint32 j = 0; j < width - 1; j++) {
-			color = ADColor(img_row[0], img_row[1], img_row[2]);
+			color = img_left_.color(img_row);
 			const uint8 d1 = ColorDist(color, color_last);
 			uint8 d2 = d1;
 			float32 min_cost = Large_Float;
 			for (sint32 d = 0; d < disp_range; d++) {
 				const sint32 xr = x - d - min_disparity;
 				if (xr > 0 && xr < width - 1) {
-					const ADColor color_r = ADColor(img_row_r[3 * xr], img_row_r[3 * xr + 1], img_row_r[3 * xr + 2]);
-					const ADColor color_last_r = ADColor(img_row_r[3 * (xr - direction)],
-						img_row_r[3 * (xr - direction) + 1],
-						img_row_r[3 * (xr - direction) + 2]);
+					const ADColor color_r = img_right_.color(xr, y);
+					const ADColor color_last_r = img_right_.color(xr - direction, y);
 					d2 = ColorDist(color_r, color_last_r);
 				}
 
@@ -161,7 +196,7 @@ void ScanlineOptimizer::ScanlineOptimizeLeftRight(const float32* cost_so_src, fl
 			// һ
 			cost_init_row += direction * disp_range;
 			cost_aggr_row += direction * disp_range;
-			img_row += direction * 3;
+			img_row += direction * img_left_.pixel_step;
 			x += direction;
 
 			// ֵ¸ֵ
@@ -172,6 +207,7 @@ void ScanlineOptimizer::ScanlineOptimizeLeftRight(const float32* cost_so_src, fl
 
 void ScanlineOptimizer::ScanlineOptimizeUpDown(const float32* cost_so_src, float32* cost_so_dst, bool is_forward)
 {
+	ADCENSUS_TRACE_SCOPE(is_forward ? "ScanlineUpToDown" : "ScanlineDownToUp");
 	const auto width = width_;
 	const auto height = height_;
 	const auto min_disparity = min_disparity_;
@@ -194,11 +230,11 @@ void ScanlineOptimizer::ScanlineOptimizeUpDown(const float32* cost_so_src, float
 		// ·ͷΪÿһе(β,dir=-1)
 		auto cost_init_col = (is_forward) ? (cost_so_src + x * disp_range) : (cost_so_src + (height - 1) * width * disp_range + x * disp_range);
 		auto cost_aggr_col = (is_forward) ? (cost_so_dst + x * disp_range) : (cost_so_dst + (height - 1) * width * disp_range + x * disp_range);
-		auto img_col = (is_forward) ? (img_left_ + 3 * x) : (img_left_ + (height - 1) * width * 3 + 3 * x);
+		auto img_col = (is_forward) ? img_left_.pixel(x, 0) : img_left_.pixel(x, height - 1);
 		sint32 y = (is_forward) ? 0 : height - 1;
 
 		// ·ϵǰҶֵһҶֵ
-		ADColor color(img_col[0], img_col[1], img_col[2]);
+		ADColor color = img_left_.color(img_col);
 		ADColor color_last = color;
 
 		// ·ϸصĴ飬ԪΪ˱߽βһ
@@ -209,7 +245,7 @@ void ScanlineOptimizer::ScanlineOptimizeUpDown(const float32* cost_so_src, float
 		memcpy(&cost_last_path[1], cost_aggr_col, disp_range * sizeof(float32));
 		cost_init_col += direction * width * disp_range;
 		cost_aggr_col += direction * width * disp_range;
-		img_col += direction * width * 3;
+		img_col += direction * img_left_.stride;
 		y += direction;
 
 		// ·ϸصСֵ
@@ -220,17 +256,15 @@ void ScanlineOptimizer::ScanlineOptimizeUpDown(const float32* cost_so_src, float
 
 		// Էϵ2ؿʼ˳ۺ
 		for (sint32 i = 0; i < height - 1; i++) {
-			color = ADColor(img_col[0], img_col[1], img_col[2]);
+			color = img_left_.color(img_col);
 			const uint8 d1 = ColorDist(color, color_last);
 			uint8 d2 = d1;
 			float32 min_cost = Large_Float;
 			for (sint32 d = 0; d < disp_range; d++) {
 				const sint32 xr = x - d - min_disparity;
 				if (xr > 0 && xr < width - 1) {
-					const ADColor color_r = ADColor(img_right_[y * width * 3 + 3 * xr], img_right_[y * width * 3 + 3 * xr + 1], img_right_[y * width * 3 + 3 * xr + 2]);
-					const ADColor color_last_r = ADColor(img_right_[(y - direction) * width * 3 + 3 * xr],
-						img_right_[(y - direction) * width * 3 + 3 * xr + 1],
-						img_right_[(y - direction) * width * 3 + 3 * xr + 2]);
+					const ADColor color_r = img_right_.color(xr, y);
+					const ADColor color_last_r = img_right_.color(xr, y - direction);
 					d2 = ColorDist(color_r, color_last_r);
 				}
 				// P1P2
@@ -269,7 +303,7 @@ void ScanlineOptimizer::ScanlineOptimizeUpDown(const float32* cost_so_src, float
 			// һ
 			cost_init_col += direction * width * disp_range;
 			cost_aggr_col += direction * width * disp_range;
-			img_col += direction * width * 3;
+			img_col += direction * img_left_.stride;
 			y += direction;
 
 			// ֵ¸ֵ
@@ -277,3 +311,126 @@ void ScanlineOptimizer::ScanlineOptimizeUpDown(const float32* cost_so_src, float
 		}
 	}
 }
+
+void ScanlineOptimizer::ComputePenalties(const sint32& x, const sint32& d1, const uint8* dist_r, uint8* edge_r, float32* p1, float32* p2) const
+{
+	const sint32 disp_range = max_disparity_ - min_disparity_;
+	const sint32 tso = so_tso_;
+
+	// ӰɫСtsoʱͷΪpp/4Ϊp/4p/10
+	if (d1 < tso) {
+		p1[0] = so_p1_; p1[1] = so_p1_ / 4;
+		p2[0] = so_p2_; p2[1] = so_p2_ / 4;
+	}
+	else {
+		p1[0] = so_p1_ / 4; p1[1] = so_p1_ / 10;
+		p2[0] = so_p2_ / 4; p2[1] = so_p2_ / 10;
+	}
+
+	// οʵһ£ͬԽʱһӲӰɫ루ֵΪӰɫ룩
+	sint32 d2 = d1;
+	for (sint32 d = 0; d < disp_range; d++) {
+		const sint32 xr = x - d - min_disparity_;
+		if (xr > 0 && xr < width_ - 1) {
+			d2 = dist_r[xr];
+		}
+		edge_r[d] = (d2 >= tso) ? 1 : 0;
+	}
+}
+
+void ScanlineOptimizer::ScanlineLeftRightKernel(const float32* cost_so_src, float32* cost_so_dst, bool is_forward)
+{
+	ADCENSUS_TRACE_SCOPE(is_forward ? "ScanlineLeftToRight" : "ScanlineRightToLeft");
+	const sint32 width = width_;
+	const sint32 height = height_;
+	const sint32 disp_range = max_disparity_ - min_disparity_;
+	const sint32 direction = is_forward ? 1 : -1;
+	const auto scanline_step = adcensus_util::GetKernels(disp_range).scanline_step;
+
+	assert(width > 0 && height > 0 && disp_range > 0);
+
+#pragma omp parallel
+	{
+		ADCENSUS_TRACE_SCOPE("ScanlineLeftRight:worker");
+		std::vector<uint8> edge_r(disp_range);
+		float32 p1[2], p2[2];
+
+#pragma omp for schedule(static)
+		for (sint32 y = 0; y < height; y++) {
+			const float32* cost_src_row = cost_so_src + static_cast<size_t>(y) * width * disp_range;
+			float32* cost_dst_row = cost_so_dst + static_cast<size_t>(y) * width * disp_range;
+
+			// ·صɫȡɫͼ·ǰһأΪ࣬ΪҲࣩľ
+			// ʱӰͼһУʹdist_r[xr]Ϊxrxr+1ľ
+			const uint8* diff_l = diff_left_h_ + y * width;
+			const uint8* dist_r = diff_right_h_ + y * width + (is_forward ? 0 : 1);
+
+			// һصľۺϴֵڳʼֵ
+			sint32 x = is_forward ? 0 : width - 1;
+			memcpy(cost_dst_row + x * disp_range, cost_src_row + x * disp_range, disp_range * sizeof(float32));
+			float32 min_last = Large_Float;
+			for (sint32 d = 0; d < disp_range; d++) {
+				min_last = std::min(min_last, cost_dst_row[x * disp_range + d]);
+			}
+
+			for (sint32 j = 0; j < width - 1; j++) {
+				const sint32 x_last = x;
+				x += direction;
+				const sint32 d1 = diff_l[is_forward ? x : x_last];
+				ComputePenalties(x, d1, dist_r, &edge_r[0], p1, p2);
+				min_last = scanline_step(cost_src_row + x * disp_range, cost_dst_row + x_last * disp_range, min_last,
+										 &edge_r[0], p1, p2, cost_dst_row + x * disp_range, disp_range);
+			}
+		}
+	}
+}
+
+void ScanlineOptimizer::ScanlineUpDownKernel(const float32* cost_so_src, float32* cost_so_dst, bool is_forward)
+{
+	ADCENSUS_TRACE_SCOPE(is_forward ? "ScanlineUpToDown" : "ScanlineDownToUp");
+	const sint32 width = width_;
+	const sint32 height = height_;
+	const sint32 disp_range = max_disparity_ - min_disparity_;
+	const sint32 direction = is_forward ? 1 : -1;
+	const auto scanline_step = adcensus_util::GetKernels(disp_range).scanline_step;
+	const size_t row_size = static_cast<size_t>(width) * disp_range;
+
+	assert(width > 0 && height > 0 && disp_range > 0);
+
+	// ·ϸصСֵ
+	std::vector<float32> min_last(width, Large_Float);
+
+	// һصľۺϴֵڳʼֵ
+	sint32 y = is_forward ? 0 : height - 1;
+	memcpy(cost_so_dst + y * row_size, cost_so_src + y * row_size, row_size * sizeof(float32));
+	for (sint32 x = 0; x < width; x++) {
+		const float32* cost = cost_so_dst + y * row_size + x * disp_range;
+		for (sint32 d = 0; d < disp_range; d++) {
+			min_last[x] = std::min(min_last[x], cost[d]);
+		}
+	}
+
+#pragma omp parallel
+	{
+		ADCENSUS_TRACE_SCOPE("ScanlineUpDown:worker");
+		std::vector<uint8> edge_r(disp_range);
+		float32 p1[2], p2[2];
+
+		for (sint32 i = 0; i < height - 1; i++) {
+			const sint32 y_last = y + i * direction;
+			const sint32 y_cur = y_last + direction;
+
+			// ·صɫȡɫͼпµһ
+			const sint32 y_diff = is_forward ? y_cur : y_last;
+			const uint8* diff_l = diff_left_v_ + y_diff * width;
+			const uint8* dist_r = diff_right_v_ + y_diff * width;
+
+#pragma omp for schedule(static)
+			for (sint32 x = 0; x < width; x++) {
+				ComputePenalties(x, diff_l[x], dist_r, &edge_r[0], p1, p2);
+				min_last[x] = scanline_step(cost_so_src + y_cur * row_size + x * disp_range, cost_so_dst + y_last * row_size + x * disp_range,
+											min_last[x], &edge_r[0], p1, p2, cost_so_dst + y_cur * row_size + x * disp_range, disp_range);
+			}
+		}
+	}
+}
@@ -10,6 +10,7 @@
 #include <algorithm>
 
 #include "adcensus_types.h"
+#include "stage_kernels.h"
 
 /**
  * \brief ɨŻ
@@ -22,12 +23,21 @@ public:
 
 	/**
 	 * \brief 
-	 * \param img_left		// Ӱݣͨ 
-	 * \param img_right 	// Ӱݣͨ
+	 * \param img_left		// Ӱͼ
+	 * \param img_right 	// Ӱͼ
 	 * \param cost_init 	// ʼ
 	 * \param cost_aggr 	// ۺϴ
 	 */
-	void SetData(const uint8* img_left, const uint8* img_right, float32* cost_init, float32* cost_aggr);
+	void SetData(const ADImageView& img_left, const ADImageView& img_right, float32* cost_init, float32* cost_aggr);
+
+	/**
+	 * \brief Ӱصɫͼadcensus_util::ComputeNeighborDiffsŻʵ֮ѡȡP1P2
+	 * \param diff_left_h	// Ӱصɫ룬width*height
+	 * \param diff_left_v	// ӰϷصɫ룬width*height
+	 * \param diff_right_h	// Ӱصɫ룬width*height
+	 * \param diff_right_v	// ӰϷصɫ룬width*height
+	 */
+	void SetColorDiffs(const uint8* diff_left_h, const uint8* diff_left_v, const uint8* diff_right_h, const uint8* diff_right_v);
 
 	/**
 	 * \brief 
@@ -41,11 +51,24 @@ public:
 	 */
 	void SetParam(const sint32& width,const sint32& height, const sint32& min_disparity, const sint32& max_disparity, const float32& p1, const float32& p2, const sint32& tso);
 
+	/**
+	 * \brief ü
+	 * \param backend		// 
+	 * \return true: úעʵ֣false: δעᣬ˻زοʵ
+	 */
+	bool SetBackend(const ADCensusBackend& backend);
+
 	/**
 	 * \brief Ż */
 	void Optimize();
 
 private:
+	/** \brief 4ɨŻοʵ֣ */
+	void OptimizeReference();
+
+	/** \brief 4ɨŻŻʵ֣صľۺʹõǰָںˣУУ */
+	void OptimizeOptimized();
+
 	/**
 	* \brief ·Ż  
 	* \param cost_so_src		룬SOǰ
@@ -62,6 +85,27 @@ private:
 	*/
 	void ScanlineOptimizeUpDown(const float32* cost_so_src, float32* cost_so_dst, bool is_forward = true);
 
+	/**
+	* \brief ·ŻŻʵ֣ͬScanlineOptimizeLeftRight
+	*/
+	void ScanlineLeftRightKernel(const float32* cost_so_src, float32* cost_so_dst, bool is_forward = true);
+
+	/**
+	* \brief ·ŻŻʵ֣ͬScanlineOptimizeUpDownƽͬһив
+	*/
+	void ScanlineUpDownKernel(const float32* cost_so_src, float32* cost_so_dst, bool is_forward = true);
+
+	/**
+	* \brief ·һظӲĳͷ
+	* \param x				к
+	* \param d1				Ӱ·صɫ
+	* \param dist_r			Ӱ·صɫ룬Ӱк
+	* \param edge_r			ӲӰɫǷСtso
+	* \param p1				ӰɫСڼСtsoʱP1
+	* \param p2				ӰɫСڼСtsoʱP2
+	*/
+	void ComputePenalties(const sint32& x, const sint32& d1, const uint8* dist_r, uint8* edge_r, float32* p1, float32* p2) const;
+
 	/** \brief ɫ */
 	inline sint32 ColorDist(const ADColor& c1, const ADColor& c2) {
 		return std::max(abs(c1.r - c2.r), std::max(abs(c1.g - c2.g), abs(c1.b - c2.b)));
@@ -72,9 +116,15 @@ private:
 	sint32	width_;
 	sint32	height_;
 
-	/** \brief Ӱ */
-	const uint8* img_left_;
-	const uint8* img_right_;
+	/** \brief Ӱͼ */
+	ADImageView img_left_;
+	ADImageView img_right_;
+
+	/** \brief Ӱصɫͼˮƽֱ */
+	const uint8* diff_left_h_;
+	const uint8* diff_left_v_;
+	const uint8* diff_right_h_;
+	const uint8* diff_right_v_;
 	
 	/** \brief ʼ */
 	float32* cost_init_;
@@ -91,5 +141,10 @@ private:
 	float32 so_p2_;
 	/** \brief tsoֵ */
 	sint32 so_tso_;
+
+	/** \brief  */
+	ADCensusBackend backend_;
+	/** \brief ɨŻĸʵ */
+	StageKernels<void (ScanlineOptimizer::*)()> optimize_kernels_;
 };
 #endif
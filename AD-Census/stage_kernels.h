@@ -0,0 +1,53 @@
+/* -*-c++-*- AD-Census - Copyright (C) 2020.
+* Author	: Yingsong Li(Ethan Li) <ethan.li.whu@gmail.com>
+* https://github.com/ethan-li-coding/AD-Census
+* Describe	: header of stage kernel registry
+*/
+
+#ifndef AD_CENSUS_STAGE_KERNELS_H_
+#define AD_CENSUS_STAGE_KERNELS_H_
+
+#include "adcensus_types.h"
+
+/**
+ * \brief ׶ںע
+ * ͬһ׶εĶʵֿ̡֣߳ȣͬһǩĳԱָ밴עᣬ
+ * ģڹʱעʵ֣ʱѡȡãδעĺ˻زοʵ֣һ˶н׶ξ
+ * \tparam Kernel	ںͣͨΪģĳԱָ
+ */
+template <typename Kernel>
+class StageKernels {
+public:
+	StageKernels() {
+		for (sint32 i = 0; i < Backend_Count; i++) {
+			kernels_[i] = nullptr;
+		}
+	}
+
+	/**
+	 * \brief עĳһ˵ʵ֣ظעʱ
+	 * \param backend	
+	 * \param kernel	ʵ
+	 */
+	void Register(const ADCensusBackend& backend, Kernel kernel) {
+		if (backend >= 0 && backend < Backend_Count) {
+			kernels_[backend] = kernel;
+		}
+	}
+
+	/** \brief Ƿעĳһ˵ʵ */
+	bool Has(const ADCensusBackend& backend) const {
+		return backend >= 0 && backend < Backend_Count && kernels_[backend] != nullptr;
+	}
+
+	/** \brief ȡĳһ˵ʵ֣δעʱزοʵ */
+	Kernel Get(const ADCensusBackend& backend) const {
+		return Has(backend) ? kernels_[backend] : kernels_[Backend_Reference];
+	}
+
+private:
+	/** \brief ˵ʵ */
+	Kernel kernels_[Backend_Count];
+};
+
+#endif